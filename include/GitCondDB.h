@@ -15,26 +15,91 @@
 
 #include <chrono>
 #include <functional>
+#include <future>
 #include <limits>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace GitCondDB {
-  inline namespace v1 {
+  inline namespace v2 {
     namespace details {
       struct DBImpl;
-    }
+      struct Prefetcher;
+      struct ThreadPool;
+    } // namespace details
 
     struct CondDB;
     struct Logger;
 
+    /// Options to tune the connection to a repository.
+    struct ConnectOptions {
+      /// Number of independent handles on a Git repository, i.e. the number of threads that can read
+      /// from it concurrently (ignored by the other backends).
+      std::size_t repository_handles = 1;
+      /// Build a table of the entries of a JSON database when loading it, for faster lookups.
+      bool json_index = true;
+      /// Decompress the payloads (and IOVs files) stored as gzip data, detected from their header, as
+      /// written by `add_files_to_gitconddb.py --compress`. Off by default, as payloads that are not
+      /// compressed may start with the same bytes.
+      /// The payload cache holds the decompressed data, keyed by the id of the compressed object.
+      bool decompress_payloads = false;
+      /// Files at least this big are mapped in memory by the file: backend instead of being read, so that
+      /// their payloads are never copied (0, the default, means always reading).
+      /// Only for files that are not modified while in use: the payloads (even those already returned or
+      /// cached) see in-place rewrites, and accessing them after the file is truncated kills the process
+      /// (SIGBUS). For this reason it is ignored when watching for changes (file_watch).
+      std::size_t file_mmap_threshold = 0;
+      /// How long the file: backend can reuse the type and size of a path without checking the filesystem
+      /// again, which saves a lot of slow calls on shared filesystems (0 disables the cache). Changes to the
+      /// files may not be seen until the cached information expires.
+      std::chrono::milliseconds file_metadata_ttl{0};
+      /// Watch (with inotify) the directories read by the file: backend, so that payloads, IOVs and listings
+      /// can be cached like for the other backends, and dropped from the caches as soon as the files change.
+      /// It replaces the metadata cache (file_metadata_ttl). Changes made on other hosts of a network
+      /// filesystem are not notified.
+      bool file_watch = false;
+      /// Maximum memory (in bytes) used by the flattened IOVs tables of the conditions with nested IOVs,
+      /// the least recently used being dropped first (0 disables the flattening).
+      std::size_t flat_iovs_cache_size = 64 * 1024 * 1024;
+      /// Maximum memory (in bytes) used to memoize the IOVs entries of the directories explored by
+      /// CondDB::iovs and CondDB::iov_boundaries, the least recently used being dropped first (0 disables it).
+      std::size_t iov_entries_cache_size = 64 * 1024 * 1024;
+
+      // Settings of libgit2 (0 means keeping the current value). They are global to the process, so they
+      // affect all the Git connections, and they are applied when connecting to a Git repository.
+
+      /// Maximum memory used by the libgit2 objects cache, shared by all repositories.
+      std::size_t git_cache_max_size = 0;
+      /// Maximum size of the blobs kept in the libgit2 objects cache (blobs are not cached by default).
+      std::size_t git_cache_blob_limit = 0;
+      /// Size of the windows used to map packfiles in memory.
+      std::size_t git_mwindow_size = 0;
+      /// Maximum memory mapped from packfiles, before closing unused windows.
+      std::size_t git_mwindow_mapped_limit = 0;
+      /// Maximum number of packfiles mapped at the same time (requires libgit2 >= 1.1).
+      std::size_t git_mwindow_file_limit = 0;
+    };
+
     GITCONDDB_EXPORT CondDB connect( std::string_view repository, std::shared_ptr<Logger> logger = nullptr );
+    GITCONDDB_EXPORT CondDB connect( std::string_view repository, const ConnectOptions& options,
+                                     std::shared_ptr<Logger> logger = nullptr );
 
     /// Interface for customizable logger
     struct Logger {
       enum class Level { Debug, Verbose, Quiet, Nothing } level = Level::Quiet;
 
+      /// Tell if messages of the given level (Debug for debug, Verbose for info and Quiet for warning)
+      /// would be printed, so that callers can avoid formatting messages that would be discarded.
+      ///
+      /// The default implementation returns true, leaving the filtering to the logging methods.
+      virtual bool enabled( Level msg_level ) const {
+        (void)msg_level;
+        return true;
+      }
+
       virtual void warning( std::string_view msg ) const = 0;
       virtual void info( std::string_view msg ) const    = 0;
       virtual void debug( std::string_view msg ) const   = 0;
@@ -71,6 +136,37 @@ namespace GitCondDB {
         bool overlaps( const IOV& other ) const { return other.intersect( *this ).valid(); }
       };
 
+      /// Read-only view of the data of a condition.
+      ///
+      /// The view is valid as long as the Payload instance (or a copy of it) is alive, because it
+      /// keeps a reference to the underlying storage (e.g. the Git blob), which is not copied. For the Git
+      /// backend, this also keeps the repository open, even after CondDB::disconnect.
+      class Payload {
+      public:
+        Payload() = default;
+        Payload( std::shared_ptr<const void> owner, std::string_view data )
+            : m_owner{std::move( owner )}, m_data{data} {}
+        /// Payload owning its data.
+        explicit Payload( std::string data ) {
+          auto storage = std::make_shared<const std::string>( std::move( data ) );
+          m_data       = *storage;
+          m_owner      = std::move( storage );
+        }
+
+        std::string_view view() const { return m_data; }
+        std::string      str() const { return std::string{m_data}; }
+
+        operator std::string_view() const { return m_data; }
+
+        const char* data() const { return m_data.data(); }
+        std::size_t size() const { return m_data.size(); }
+        bool        empty() const { return m_data.empty(); }
+
+      private:
+        std::shared_ptr<const void> m_owner;
+        std::string_view            m_data;
+      };
+
       /// RAII object to limit the time the connection to the repository stay open.
       /// The lifetime of the CondDB object must be longer than the AccessGuard.
       class AccessGuard {
@@ -83,6 +179,84 @@ namespace GitCondDB {
         ~AccessGuard() { db.disconnect(); }
       };
 
+      /// Helper to look up a condition at time points that mostly increase (e.g. in an event loop).
+      ///
+      /// The last payload is returned as long as the time point stays in its IOV, and the IOVs
+      /// tables (including nested ones) are searched forward from the previously found entries.
+      /// The lifetime of the CondDB object must be longer than the Cursor.
+      class Cursor {
+      public:
+        Cursor( Cursor&& );
+        Cursor& operator=( Cursor&& );
+        ~Cursor();
+
+        /// Same as CondDB::get_payload for the key (tag, path, t).
+        std::tuple<Payload, IOV> at( time_point_t t );
+
+      private:
+        friend struct CondDB;
+        Cursor( const CondDB& db, std::string_view tag, std::string_view path );
+
+        /// An IOVs table on the way to the current payload.
+        struct Level;
+
+        const CondDB*      m_db;
+        std::string        m_tag;
+        std::string        m_path;
+        std::vector<Level> m_levels;
+        Payload            m_payload;
+        IOV                m_iov{0, 0};
+      };
+
+      /// View of the database at a fixed version, obtained with CondDB::pin.
+      ///
+      /// The tag is resolved only once (for Git, to the id of the commit it points to), so all the lookups
+      /// through the view see the same version, even if the tag (e.g. HEAD or a branch) is moved.
+      /// The lifetime of the CondDB object must be longer than the TagView.
+      class TagView {
+      public:
+        /// Name of the tag the view was created from.
+        const std::string& tag() const { return m_tag; }
+        /// Identifier of the pinned version (the commit id for Git, the tag itself for the other backends).
+        const std::string& id() const { return m_id; }
+
+        std::tuple<std::string, IOV> get( std::string_view path, time_point_t time_point ) const {
+          return m_db->get( {m_id, std::string{path}, time_point} );
+        }
+        std::tuple<Payload, IOV> get_payload( std::string_view path, time_point_t time_point ) const {
+          return m_db->get_payload( {m_id, std::string{path}, time_point} );
+        }
+        Cursor cursor( std::string_view path ) const { return m_db->cursor( m_id, path ); }
+
+        std::vector<time_point_t> iov_boundaries( std::string_view path ) const {
+          return m_db->iov_boundaries( m_id, path );
+        }
+        std::vector<time_point_t> iov_boundaries( std::string_view path, const IOV& boundaries ) const {
+          return m_db->iov_boundaries( m_id, path, boundaries );
+        }
+        std::vector<std::tuple<IOV, std::string>> iovs( std::string_view path ) const {
+          return m_db->iovs( m_id, path );
+        }
+        std::vector<std::tuple<IOV, std::string>> iovs( std::string_view path, const IOV& boundaries ) const {
+          return m_db->iovs( m_id, path, boundaries );
+        }
+
+        std::chrono::system_clock::time_point commit_time() const { return m_db->commit_time( m_id ); }
+
+      private:
+        friend struct CondDB;
+        TagView( const CondDB& db, std::string tag, std::string id )
+            : m_db{&db}, m_tag{std::move( tag )}, m_id{std::move( id )} {}
+
+        const CondDB* m_db;
+        std::string   m_tag;
+        std::string   m_id;
+      };
+
+      /// Close the repository (it is reopened by the next access).
+      ///
+      /// The cached payloads are dropped, as they refer to the repository data, but the Payload instances
+      /// still in use by the caller keep the repository open until they are destroyed.
       void disconnect() const;
 
       bool connected() const;
@@ -94,6 +268,50 @@ namespace GitCondDB {
 
       std::tuple<std::string, IOV> get( const Key& key, const IOV& bounds ) const;
 
+      /// Same as get, but giving access to the data without copying it.
+      std::tuple<Payload, IOV> get_payload( const Key& key ) const { return get_payload( key, {} ); }
+
+      std::tuple<Payload, IOV> get_payload( const Key& key, const IOV& bounds ) const;
+
+      /// Get the payloads and IOVs for several keys at once (results are in the same order as the keys).
+      ///
+      /// Each object (directory, IOVs file or payload) is read only once per call, even if it is
+      /// shared by several keys.
+      std::vector<std::tuple<Payload, IOV>> get_many( const std::vector<Key>& keys ) const;
+
+      /// Function scheduling the execution of a task, e.g. on the task scheduler of the host application.
+      using executor_t = std::function<void( std::function<void()> task )>;
+
+      /// Set the executor used by the asynchronous lookups (get_async, get_many_async).
+      ///
+      /// By default (or if set to nullptr) the tasks are executed by an internal pool of threads (as many
+      /// as the backend can use concurrently, see ConnectOptions::repository_handles).
+      /// The CondDB instance must outlive the tasks submitted to a custom executor.
+      void set_executor( executor_t executor ) { m_executor = std::move( executor ); }
+
+      /// Same as get, but executed asynchronously (see set_executor).
+      std::future<std::tuple<std::string, IOV>> get_async( Key key ) const;
+
+      /// Same as get_many, but executed asynchronously (see set_executor).
+      std::future<std::vector<std::tuple<Payload, IOV>>> get_many_async( std::vector<Key> keys ) const;
+
+      /// Get a Cursor to look up a condition at increasing time points.
+      Cursor cursor( std::string_view tag, std::string_view path ) const { return {*this, tag, path}; }
+
+      /// Load in the caches what is needed to look up the conditions under a path prefix within a range.
+      ///
+      /// The conditions are looked up at the beginning of each of their IOVs in the range, using `threads`
+      /// threads (0 means as many as the backend can use, see ConnectOptions::repository_handles), so that
+      /// the IOVs tables are parsed and, if the payload cache is enabled (see set_payload_cache_size), the
+      /// payloads are in the cache.
+      ///
+      /// Returns the number of payloads looked up.
+      std::size_t preload( std::string_view tag, std::string_view prefix, const IOV& range,
+                           std::size_t threads = 0 ) const;
+
+      /// Get a view of the database at the version currently pointed to by a tag.
+      TagView pin( std::string_view tag ) const;
+
       std::chrono::system_clock::time_point commit_time( const std::string& commit_id ) const;
 
       std::vector<time_point_t> iov_boundaries( std::string_view tag, std::string_view path ) const {
@@ -102,7 +320,35 @@ namespace GitCondDB {
       std::vector<time_point_t> iov_boundaries( std::string_view tag, std::string_view path,
                                                 const IOV& boundaries ) const;
 
-      CondDB( CondDB&& ) = default;
+      /// Get the IOVs of a condition within the given boundaries, with the path of the corresponding payloads
+      /// (resolving nested IOVs tables), so that the payloads can be retrieved with a plain get.
+      ///
+      /// The entries of nested IOVs tables are memoized by content (e.g. Git tree id), and, if the backend
+      /// supports concurrent reads (see ConnectOptions::repository_handles), the entries of the top level
+      /// table are explored in parallel.
+      std::vector<std::tuple<IOV, std::string>> iovs( std::string_view tag, std::string_view path ) const {
+        return iovs( tag, path, {} );
+      }
+      std::vector<std::tuple<IOV, std::string>> iovs( std::string_view tag, std::string_view path,
+                                                      const IOV& boundaries ) const;
+
+      /// Get the identifier of the content of the object get would return for a key (e.g. the Git blob id
+      /// of the payload), to tell if it changed without reading it.
+      ///
+      /// The identifier is empty if the key does not match any object or if the backend cannot identify
+      /// contents (see has_content_ids). Objects with the same identifier have the same content, also
+      /// across connections to the same repository.
+      std::string content_id( const Key& key ) const;
+
+      /// Same as get_payload, also returning the content id of the payload (see content_id), without
+      /// resolving the key twice.
+      std::tuple<Payload, IOV, std::string> get_payload_with_id( const Key& key ) const;
+
+      /// True if the backend can identify contents (all but the file: backend without
+      /// ConnectOptions::file_watch).
+      bool has_content_ids() const;
+
+      CondDB( CondDB&& );
       ~CondDB();
 
       struct dir_content {
@@ -123,11 +369,108 @@ namespace GitCondDB {
       bool iov_reduction() const { return m_reduce_iovs; }
       void set_iov_reduction( bool value ) { m_reduce_iovs = value; }
 
+      /// Statistics of a cache.
+      struct CacheStats {
+        std::size_t hits      = 0;
+        std::size_t misses    = 0;
+        std::size_t evictions = 0;
+        std::size_t entries   = 0;
+        std::size_t bytes     = 0;
+        std::size_t max_bytes = 0;
+      };
+
+      /// Set the size (in bytes) of the cache of payloads, 0 (the default) to disable it.
+      ///
+      /// Payloads are cached by content (e.g. Git blob id), so that identical payloads reached via
+      /// different tags or paths are stored only once. Any payload up to the whole size can be cached,
+      /// the least recently used ones being dropped to make room.
+      void        set_payload_cache_size( std::size_t max_bytes );
+      std::size_t payload_cache_size() const;
+      CacheStats  payload_cache_stats() const;
+
+      /// Enable or disable the prefetching of payloads.
+      ///
+      /// When enabled, each lookup (get, get_payload, Cursor::at) schedules, in a background thread, the
+      /// lookup of the same condition at the end of the returned IOV, so that the payload of the next IOV
+      /// is already in the payload cache when it is needed. It has no effect if the payload cache is
+      /// disabled (see set_payload_cache_size).
+      void set_prefetch( bool value );
+      bool prefetch() const { return bool{m_prefetcher}; }
+
+      /// Distribution of durations.
+      struct LatencyHistogram {
+        /// Number of durations in [2^i, 2^(i+1)) ns for each bucket i (the first one also counts shorter
+        /// durations and the last one longer durations).
+        std::vector<std::size_t> counts;
+        std::size_t              count = 0;
+        std::chrono::nanoseconds total{0};
+      };
+
+      /// Snapshot of the statistics of the accesses to the database.
+      struct GITCONDDB_EXPORT Stats {
+        /// Name of the backend ("git", "file" or "json").
+        std::string backend;
+        /// Number of lookups (get, get_payload, keys in get_many, Cursor::at outside of the current IOV,
+        /// prefetching and preloading).
+        std::size_t lookups = 0;
+        /// Number of objects (files or directories) read from the backend.
+        std::size_t objects = 0;
+        /// Size of the files read from the backend.
+        std::size_t bytes = 0;
+        /// Cache of parsed IOVs files (only hits and misses are filled).
+        CacheStats iov_cache;
+        /// Cache of directory listings (only hits and misses are filled).
+        CacheStats listing_cache;
+        CacheStats payload_cache;
+        /// Cache of the flattened IOVs of conditions (see ConnectOptions::flat_iovs_cache_size).
+        CacheStats flat_iovs_cache;
+        /// Memoized IOVs entries (see ConnectOptions::iov_entries_cache_size).
+        CacheStats iov_entries_cache;
+
+        LatencyHistogram lookup_latency;
+        /// Time spent reading objects from the backend (e.g. in libgit2).
+        LatencyHistogram read_latency;
+        LatencyHistogram iov_parse_latency;
+
+        /// Text representation in the Prometheus exposition format.
+        std::string dump() const;
+      };
+
+      /// Get a snapshot of the counters and latency histograms, which are always collected.
+      Stats stats() const;
+      /// Reset the counters and histograms (the content of the caches is not affected).
+      void reset_stats();
+
     private:
       CondDB( std::unique_ptr<details::DBImpl> impl );
 
+      struct LookupMemo;
+
+      /// Implementation of get_payload, optionally reusing the objects already loaded in `memo`.
+      ///
+      /// It does not depend on the CondDB instance, so that it can be used from background tasks.
+      /// If `payload_id` is not null, it is set to the content id of the returned object (see content_id).
+      static std::tuple<Payload, IOV> lookup( const details::DBImpl& impl, bool reduce_iovs,
+                                              const dir_converter_t& dir_converter, const Key& key,
+                                              const IOV& bounds, LookupMemo* memo,
+                                              std::string* payload_id = nullptr );
+
+      /// Implementation of get_many, which does not depend on the CondDB instance (see lookup).
+      static std::vector<std::tuple<Payload, IOV>> lookup_many( const details::DBImpl& impl, bool reduce_iovs,
+                                                                const dir_converter_t&  dir_converter,
+                                                                const std::vector<Key>& keys );
+
+      /// Run a task with the executor (or the internal pool of threads).
+      void execute( std::function<void()> task ) const;
+
+      /// Schedule the lookup of the condition after the given IOV (if prefetching is enabled).
+      void prefetch_after( std::string_view tag, std::string_view path, const IOV& iov ) const;
+
+      /// Collect the IOVs and payload ids of the condition `object_id` within `limits`, using up to
+      /// `concurrency` threads for the entries of its IOVs table.
       void iov_boundaries_accumulate( const std::string& object_id, const IOV& limits,
-                                      std::vector<std::pair<IOV, std::string>>& acc ) const;
+                                      std::vector<std::pair<IOV, std::string>>& acc,
+                                      const std::size_t concurrency = 1 ) const;
 
       std::unique_ptr<details::DBImpl> m_impl;
 
@@ -136,9 +479,17 @@ namespace GitCondDB {
       /// If true, hide IOV boundaries if the payload does not change.
       bool m_reduce_iovs = true;
 
-      friend GITCONDDB_EXPORT CondDB connect( std::string_view repository, std::shared_ptr<Logger> logger );
+      /// Background thread for the prefetching of payloads (if enabled).
+      std::unique_ptr<details::Prefetcher> m_prefetcher;
+
+      /// Executor for the asynchronous lookups, or the internal pool of threads if not set.
+      executor_t                           m_executor;
+      std::unique_ptr<details::ThreadPool> m_thread_pool;
+
+      friend GITCONDDB_EXPORT CondDB connect( std::string_view repository, const ConnectOptions& options,
+                                              std::shared_ptr<Logger> logger );
     };
-  } // namespace v1
+  } // namespace v2
 } // namespace GitCondDB
 
 #endif // GITCONDDB_H
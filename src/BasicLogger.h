@@ -16,20 +16,22 @@
 #include <iomanip>
 #include <iostream>
 
-using namespace GitCondDB::v1;
+using namespace GitCondDB::v2;
 
 struct BasicLogger : Logger {
   inline void print( std::string_view level, std::string_view msg ) const {
     std::cout << std::left << std::setw( 7 ) << level << ':' << ' ' << msg << '\n';
   }
+  bool enabled( Level msg_level ) const override { return level <= msg_level; }
+
   void warning( std::string_view msg ) const override {
-    if ( level <= Level::Quiet ) print( "warning", msg );
+    if ( enabled( Level::Quiet ) ) print( "warning", msg );
   }
   void info( std::string_view msg ) const override {
-    if ( level <= Level::Verbose ) print( "info", msg );
+    if ( enabled( Level::Verbose ) ) print( "info", msg );
   }
   void debug( std::string_view msg ) const override {
-    if ( level <= Level::Debug ) print( "debug", msg );
+    if ( enabled( Level::Debug ) ) print( "debug", msg );
   }
 };
 
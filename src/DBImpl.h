@@ -21,18 +21,32 @@ namespace fs = std::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
+#include "cache_helpers.h"
+#include "compression_helpers.h"
+#include "fs_helpers.h"
 #include "git_helpers.h"
+#include "iov_helpers.h"
+#include "stats_helpers.h"
 
 #include "common.h"
 
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 
 #include <fmt/core.h>
 #include <nlohmann/json.hpp>
 
 namespace GitCondDB {
-  inline namespace v1 {
+  inline namespace v2 {
     namespace details {
       template <class RET, class FUNC, class... ARGS>
       RET git_call( std::string_view err_msg, std::string_view key, FUNC func, ARGS&&... args ) {
@@ -44,6 +58,7 @@ namespace GitCondDB {
 
       /// Helper no-op logger to simplify implementations
       struct NullLogger : Logger {
+        bool enabled( Level ) const override { return false; }
         void warning( std::string_view ) const override {}
         void info( std::string_view ) const override {}
         void debug( std::string_view ) const override {}
@@ -52,6 +67,7 @@ namespace GitCondDB {
       class DBImpl {
       public:
         using dir_content = CondDB::dir_content;
+        using payload_t   = CondDB::Payload;
 
         virtual ~DBImpl() = default;
 
@@ -59,12 +75,206 @@ namespace GitCondDB {
 
         virtual bool connected() const = 0;
 
+        /// Short name of the backend (e.g. "git").
+        virtual const char* backend_name() const = 0;
+
         virtual bool exists( const char* object_id ) const = 0;
 
-        virtual std::variant<std::string, dir_content> get( const char* object_id ) const = 0;
+        /// Get the data of a file or the content of a directory.
+        std::variant<payload_t, dir_content> get_payload( const char* object_id ) const {
+          std::variant<payload_t, dir_content> out;
+          {
+            Helpers::scoped_timer timer{m_stats.read_latency};
+            out = read_payload( object_id );
+          }
+          m_stats.count( m_stats.objects );
+          if ( out.index() == 0 ) {
+            const auto& data = std::get<0>( out );
+            m_stats.count( m_stats.bytes, data.size() );
+            if ( m_decompress && Helpers::is_gzip( data ) ) out = payload_t{Helpers::gunzip( data )};
+          }
+          return out;
+        }
+
+        /// Enable or disable the transparent decompression of gzip payloads in get_payload (off by default).
+        void set_decompress( bool decompress ) { m_decompress = decompress; }
+
+        /// Drop from the caches the entries referring to the storage of the backend (payloads and binary
+        /// IOVs files, e.g. Git blobs or mapped files), so that they do not keep it open after a disconnect.
+        void drop_cached_payloads() const {
+          m_payload_cache.clear();
+          std::unique_lock<std::shared_mutex> guard( m_iov_cache_mutex );
+          for ( auto& cache : m_iov_cache ) {
+            for ( auto it = cache.begin(); it != cache.end(); ) {
+              it = it->second->binary.empty() ? std::next( it ) : cache.erase( it );
+            }
+          }
+        }
+
+        /// Backend specific implementation of get_payload (which also updates the statistics).
+        virtual std::variant<payload_t, dir_content> read_payload( const char* object_id ) const = 0;
+
+        /// Same as get_payload, but returning a copy of the data.
+        std::variant<std::string, dir_content> get( const char* object_id ) const {
+          auto data = get_payload( object_id );
+          if ( data.index() == 0 ) return std::get<0>( data ).str();
+          return std::move( std::get<1>( data ) );
+        }
 
         virtual std::chrono::system_clock::time_point commit_time( const char* commit_id ) const = 0;
 
+        /// Identifier of the content of an object (e.g. the Git object id).
+        ///
+        /// Objects with the same (non empty) id have the same content, recursively in the case of directories.
+        /// An empty id is returned if the object does not exist or if the backend cannot guarantee
+        /// the uniqueness of the id.
+        virtual std::string content_id( const char* object_id ) const = 0;
+
+        /// Resolve a tag to an immutable identifier of the version it points to, usable as a tag.
+        ///
+        /// The default implementation returns the tag unchanged (for backends without versions).
+        virtual std::string pin( std::string_view tag ) const { return std::string{tag}; }
+
+        /// True if content_id returns an empty id only for objects that do not exist.
+        virtual bool has_content_ids() const { return true; }
+
+        /// Number of threads that can usefully read from the backend at the same time.
+        virtual std::size_t concurrency() const { return 1; }
+
+        /// Get the parsed content of an IOVs file (text or binary), cached by content id if possible.
+        std::shared_ptr<const Helpers::IOVIndex> iov_index( const char* object_id, const bool reduce_iovs ) const {
+          return iov_index( object_id, reduce_iovs, content_id( object_id ) );
+        }
+
+        /// Same as iov_index( object_id, reduce_iovs ), for an IOVs file with the given content id.
+        std::shared_ptr<const Helpers::IOVIndex> iov_index( const char* object_id, const bool reduce_iovs,
+                                                            std::string id ) const {
+          auto& cache = m_iov_cache[reduce_iovs];
+
+          if ( LIKELY( !id.empty() ) ) {
+            std::shared_lock<std::shared_mutex> guard( m_iov_cache_mutex );
+            if ( auto it = cache.find( id ); it != cache.end() ) {
+              m_stats.count( m_stats.iov_hits );
+              return it->second;
+            }
+          }
+          m_stats.count( m_stats.iov_misses );
+
+          const auto                               data   = std::get<0>( get_payload( object_id ) );
+          const auto                               binary = binary_IOVs_of( object_id, data );
+          std::shared_ptr<const Helpers::IOVIndex> index;
+          {
+            Helpers::scoped_timer timer{m_stats.iov_parse_latency};
+            index = std::make_shared<const Helpers::IOVIndex>(
+                binary.empty() ? Helpers::parse_IOVs_index( data, reduce_iovs )
+                               : Helpers::binary_IOVs_index( binary, reduce_iovs ) );
+          }
+
+          if ( LIKELY( !id.empty() ) ) {
+            std::unique_lock<std::shared_mutex> guard( m_iov_cache_mutex );
+            cache.emplace( std::move( id ), index );
+          }
+          return index;
+        }
+
+        /// True if a directory is a condition, i.e. if it contains an IOVs file (the binary version of it
+        /// is only an optional companion).
+        bool is_condition( const std::string& object_id ) const {
+          std::string iovs_id;
+          return !find_iovs_file( object_id, iovs_id ).empty();
+        }
+
+        /// Object id of the IOVs file of a directory, setting `iovs_id` to its content id. An empty string
+        /// is returned if the directory is not a condition.
+        std::string find_iovs_file( const std::string& object_id, std::string& iovs_id ) const {
+          auto iovs_file = fmt::format( "{}/{}", object_id, Helpers::IOVs_file_name );
+          iovs_id        = content_id( iovs_file.c_str() );
+          if ( !iovs_id.empty() || ( !has_content_ids() && exists( iovs_file.c_str() ) ) ) return iovs_file;
+          return {};
+        }
+
+        /// Get the content of a directory (as returned by get_payload) with the subdirectories containing
+        /// an IOVs file (i.e. conditions) moved to the files, and both lists sorted.
+        ///
+        /// The result is cached by content id if possible.
+        std::shared_ptr<const dir_content> conditions_listing( const char* object_id, dir_content content ) const {
+          auto id = content_id( object_id );
+          if ( LIKELY( !id.empty() ) ) {
+            std::shared_lock<std::shared_mutex> guard( m_listing_cache_mutex );
+            if ( auto it = m_listing_cache.find( id ); it != m_listing_cache.end() ) {
+              m_stats.count( m_stats.listing_hits );
+              return it->second;
+            }
+          }
+          m_stats.count( m_stats.listing_misses );
+
+          std::vector<std::string> conditions;
+          classify_dirs( object_id, content.dirs, conditions );
+          content.files.insert( end( content.files ), std::make_move_iterator( begin( conditions ) ),
+                                std::make_move_iterator( end( conditions ) ) );
+          for ( auto* names : {&content.files, &content.dirs} ) {
+            if ( !std::is_sorted( begin( *names ), end( *names ) ) ) std::sort( begin( *names ), end( *names ) );
+          }
+          auto listing = std::make_shared<const dir_content>( std::move( content ) );
+
+          if ( LIKELY( !id.empty() ) ) {
+            std::unique_lock<std::shared_mutex> guard( m_listing_cache_mutex );
+            m_listing_cache.emplace( std::move( id ), listing );
+          }
+          return listing;
+        }
+
+        /// IOVs of a nested IOVs table with the (relative) path of their payloads.
+        using iov_entries_t = std::vector<std::pair<CondDB::IOV, std::string>>;
+
+        /// Get the memoized IOVs entries for the given key (see CondDB::iovs), nullptr if not known.
+        std::shared_ptr<const iov_entries_t> find_iov_entries( const std::string& key ) const {
+          auto entries = m_iov_entries.find( key );
+          return entries ? std::move( *entries ) : nullptr;
+        }
+        void store_iov_entries( std::string key, std::shared_ptr<const iov_entries_t> entries ) const {
+          const std::size_t size = sizeof( iov_entries_t ) + key.size() +
+                                   std::accumulate( begin( *entries ), end( *entries ), std::size_t{0},
+                                                    []( std::size_t n, const iov_entries_t::value_type& entry ) {
+                                                      return n + sizeof( entry ) + entry.second.size();
+                                                    } );
+          m_iov_entries.insert( std::move( key ), std::move( entries ), size );
+        }
+
+        using iov_entries_cache_t = Helpers::lru_cache<std::shared_ptr<const iov_entries_t>>;
+
+        /// Cache of the memoized IOVs entries (see CondDB::iovs).
+        iov_entries_cache_t& iov_entries_cache() const { return m_iov_entries; }
+
+        /// Get the flattened IOVs of the condition with the given content id, nullptr if not known.
+        std::shared_ptr<const Helpers::FlatIOVs> find_flat_iovs( const std::string& id, const bool reduce_iovs ) const {
+          auto flat = m_flat_iovs.find( flat_iovs_key( id, reduce_iovs ) );
+          return flat ? std::move( *flat ) : nullptr;
+        }
+        void store_flat_iovs( const std::string& id, const bool reduce_iovs,
+                              std::shared_ptr<const Helpers::FlatIOVs> flat ) const {
+          const std::size_t size = sizeof( Helpers::FlatIOVs ) + flat->since.size() * sizeof( CondDB::time_point_t ) +
+                                   flat->key_ids.size() * sizeof( std::uint32_t ) +
+                                   std::accumulate( begin( flat->keys ), end( flat->keys ), std::size_t{0},
+                                                    []( std::size_t n, const std::string& key ) {
+                                                      return n + sizeof( std::string ) + key.size();
+                                                    } );
+          m_flat_iovs.insert( flat_iovs_key( id, reduce_iovs ), std::move( flat ), size );
+        }
+
+        using flat_iovs_cache_t = Helpers::lru_cache<std::shared_ptr<const Helpers::FlatIOVs>>;
+
+        /// Cache of the flattened IOVs of conditions (see CondDB::get_payload).
+        flat_iovs_cache_t& flat_iovs_cache() const { return m_flat_iovs; }
+
+        using payload_cache_t = Helpers::lru_cache<payload_t>;
+
+        /// Cache of payloads by content id.
+        payload_cache_t& payload_cache() const { return m_payload_cache; }
+
+        /// Counters and latency histograms (see CondDB::stats).
+        Helpers::backend_stats& stats() const { return m_stats; }
+
         inline static std::string_view strip_tag( std::string_view object_id ) {
           if ( const auto pos = object_id.find_first_of( ':' ); pos != object_id.npos ) {
             object_id.remove_prefix( pos + 1 );
@@ -84,60 +294,179 @@ namespace GitCondDB {
         Logger* logger() const { return log.get(); }
 
         // logging helpers
-        void debug( std::string_view msg ) const { log->debug( msg ); }
-        void info( std::string_view msg ) const { log->info( msg ); }
-        void warning( std::string_view msg ) const { log->warning( msg ); }
+        //
+        // The messages can be passed as callables returning a string, which are invoked only if the
+        // level is enabled in the logger, so that no formatting happens for discarded messages.
+        void debug( std::string_view msg ) const { log_if( Logger::Level::Debug, &Logger::debug, msg ); }
+        void info( std::string_view msg ) const { log_if( Logger::Level::Verbose, &Logger::info, msg ); }
+        void warning( std::string_view msg ) const { log_if( Logger::Level::Quiet, &Logger::warning, msg ); }
+        template <typename F, typename = std::enable_if_t<std::is_invocable_v<F>>>
+        void debug( F&& make_msg ) const {
+          log_if( Logger::Level::Debug, &Logger::debug, std::forward<F>( make_msg ) );
+        }
+        template <typename F, typename = std::enable_if_t<std::is_invocable_v<F>>>
+        void info( F&& make_msg ) const {
+          log_if( Logger::Level::Verbose, &Logger::info, std::forward<F>( make_msg ) );
+        }
+        template <typename F, typename = std::enable_if_t<std::is_invocable_v<F>>>
+        void warning( F&& make_msg ) const {
+          log_if( Logger::Level::Quiet, &Logger::warning, std::forward<F>( make_msg ) );
+        }
+
+      protected:
+        /// Move from `dirs` to `conditions` the subdirectories of a directory that are conditions.
+        ///
+        /// The default implementation uses is_condition for each subdirectory.
+        virtual void classify_dirs( const char* object_id, std::vector<std::string>& dirs,
+                                    std::vector<std::string>& conditions ) const {
+          std::vector<std::string> plain_dirs;
+          plain_dirs.reserve( dirs.size() );
+          for ( auto& dir : dirs ) {
+            ( is_condition( fmt::format( "{}/{}", object_id, dir ) ) ? conditions : plain_dirs )
+                .emplace_back( std::move( dir ) );
+          }
+          dirs = std::move( plain_dirs );
+        }
+
+        /// Drop from the caches what was stored for objects with the given content ids, for backends
+        /// that can tell when the content of an object changes.
+        void forget_content_ids( const std::vector<std::string>& ids ) const {
+          {
+            std::unique_lock<std::shared_mutex> guard( m_iov_cache_mutex );
+            for ( auto& cache : m_iov_cache ) {
+              for ( const auto& id : ids ) cache.erase( id );
+            }
+          }
+          {
+            std::unique_lock<std::shared_mutex> guard( m_listing_cache_mutex );
+            for ( const auto& id : ids ) m_listing_cache.erase( id );
+          }
+          for ( const auto& id : ids ) {
+            m_flat_iovs.erase( flat_iovs_key( id, false ) );
+            m_flat_iovs.erase( flat_iovs_key( id, true ) );
+          }
+          {
+            // the memoized entries are keyed by content id and boundaries ("<id>:<since>-<until>")
+            const std::unordered_set<std::string_view> dropped( begin( ids ), end( ids ) );
+            m_iov_entries.erase_if(
+                [&dropped]( std::string_view key ) { return dropped.count( key.substr( 0, key.rfind( ':' ) ) ); } );
+          }
+          for ( const auto& id : ids ) m_payload_cache.erase( id );
+        }
 
       private:
+        /// Key of the flattened IOVs of a condition in the cache (they depend on the IOV reduction).
+        static std::string flat_iovs_key( const std::string& id, const bool reduce_iovs ) {
+          return ( reduce_iovs ? "r:" : "n:" ) + id;
+        }
+
+        /// Data of the binary version of the IOVs file `object_id` with content `text`, or an empty payload
+        /// if there is none or if it was not generated from that content.
+        payload_t binary_IOVs_of( const char* object_id, std::string_view text ) const {
+          const auto binary_id = std::string{object_id} + ".bin"; // "IOVs.bin"
+          if ( !exists( binary_id.c_str() ) ) return {};
+          auto data = get_payload( binary_id.c_str() );
+          if ( data.index() == 0 && Helpers::binary_IOVs_match( std::get<0>( data ), text ) )
+            return std::move( std::get<0>( data ) );
+          warning( [&binary_id]() { return fmt::format( "ignoring outdated or invalid {}", binary_id ); } );
+          return {};
+        }
+
+        template <typename MSG>
+        void log_if( Logger::Level level, void ( Logger::*method )( std::string_view ) const, MSG&& msg ) const {
+          if ( LIKELY( !log->enabled( level ) ) ) return;
+          if constexpr ( std::is_invocable_v<MSG> ) {
+            ( log.get()->*method )( msg() );
+          } else {
+            ( log.get()->*method )( msg );
+          }
+        }
+
         std::shared_ptr<Logger> log;
+
+        /// Parsed IOVs files by content id, with and without IOV reduction.
+        mutable std::unordered_map<std::string, std::shared_ptr<const Helpers::IOVIndex>> m_iov_cache[2];
+        mutable std::shared_mutex                                                          m_iov_cache_mutex;
+
+        /// Classified directory listings by content id.
+        mutable std::unordered_map<std::string, std::shared_ptr<const dir_content>> m_listing_cache;
+        mutable std::shared_mutex                                                    m_listing_cache_mutex;
+
+        /// Memoized IOVs entries by content id and boundaries.
+        mutable iov_entries_cache_t m_iov_entries{ConnectOptions{}.iov_entries_cache_size};
+
+        /// Flattened IOVs of conditions by content id, with and without IOV reduction.
+        mutable flat_iovs_cache_t m_flat_iovs{ConnectOptions{}.flat_iovs_cache_size};
+
+        mutable payload_cache_t m_payload_cache;
+
+        mutable Helpers::backend_stats m_stats;
+
+        bool m_decompress = false;
       };
 
       class GitImpl : public DBImpl {
         using git_object_ptr     = GitCondDB::Helpers::git_object_ptr;
-        using git_repository_ptr = GitCondDB::Helpers::git_repository_ptr;
+        using git_tree_entry_ptr = GitCondDB::Helpers::git_tree_entry_ptr;
+
+        /// Connection to the repository, with the objects that belong to it.
+        struct handle_t {
+          std::shared_ptr<git_repository> repository;
+          /// Root trees of the tags used so far.
+          std::map<std::string, git_object_ptr, std::less<>> trees;
+        };
+
+        using pool_t = Helpers::exclusive_pool<handle_t>;
 
       public:
-        GitImpl( std::string_view repository, std::shared_ptr<Logger> logger = nullptr )
+        /// Connect to a Git repository, using `handles` independent connections to it, so that as
+        /// many threads can read from it concurrently.
+        GitImpl( std::string_view repository, std::shared_ptr<Logger> logger = nullptr, std::size_t handles = 1 )
+            : GitImpl{repository, std::move( logger ), ConnectOptions{handles}} {}
+
+        /// Connect to a Git repository, applying the libgit2 settings in the options (which are global
+        /// to the process).
+        GitImpl( std::string_view repository, std::shared_ptr<Logger> logger, const ConnectOptions& options )
             : DBImpl{std::move( logger )}
+            , m_library{std::make_shared<Helpers::git_library>()}
             , m_repository_url( repository )
-            , m_repository{[this]() -> git_repository_ptr::storage_t {
-              info( fmt::format( "opening Git repository '{}'", m_repository_url ) );
-              auto res = git_call<git_repository_ptr::storage_t>( "cannot open repository", m_repository_url,
-                                                                  git_repository_open, m_repository_url.c_str() );
-              if ( UNLIKELY( !res ) ) throw std::runtime_error{"invalid Git repository: '" + m_repository_url + "'"};
-              return res;
-            }} {
-          // Initialize Git library
-          git_libgit2_init();
-
+            , m_handles( options.repository_handles ) {
+          set_library_options( options );
           // try access during construction
-          m_repository.get();
-        }
-
-        ~GitImpl() override {
-          // Finalize Git library
-          git_libgit2_shutdown();
+          checkout();
         }
 
         void disconnect() const override {
           debug( "disconnect from Git repository" );
-          m_repository.reset();
+          for ( std::size_t i = 0; i < m_handles.size(); ++i ) {
+            auto handle = m_handles.acquire( i );
+            if ( handle->repository ) {
+              // cached trees belong to the repository, so they must go first
+              handle->trees.clear();
+              handle->repository.reset();
+              --m_open_handles;
+            }
+          }
         }
 
-        bool connected() const override { return m_repository.is_set(); }
+        bool connected() const override { return m_open_handles.load(); }
+
+        const char* backend_name() const override { return "git"; }
 
         bool exists( const char* object_id ) const override {
-          git_object* tmp = nullptr;
-          git_revparse_single( &tmp, m_repository.get(), object_id );
+          auto        handle = checkout();
+          git_object* tmp    = nullptr;
+          lookup( *handle, &tmp, object_id );
           bool result = tmp;
           git_object_free( tmp );
           return result;
         }
 
-        std::variant<std::string, dir_content> get( const char* object_id ) const override {
-          debug( std::string{"get Git object "} + object_id );
-          std::variant<std::string, dir_content> out;
-          auto                                   obj = get_object( object_id );
+        std::variant<payload_t, dir_content> read_payload( const char* object_id ) const override {
+          debug( [object_id]() { return std::string{"get Git object "} + object_id; } );
+          std::variant<payload_t, dir_content> out;
+          auto                                 handle = checkout();
+          auto                                 obj    = get_object( *handle, object_id );
           if ( git_object_type( obj.get() ) == GIT_OBJ_TREE ) {
             debug( "found tree object" );
 
@@ -158,77 +487,259 @@ namespace GitCondDB {
           } else {
             debug( "found blob object" );
 
-            auto blob = reinterpret_cast<const git_blob*>( obj.get() );
-            out       = std::string{reinterpret_cast<const char*>( git_blob_rawcontent( blob ) ),
-                              static_cast<std::size_t>( git_blob_rawsize( blob ) )};
+            auto                   blob = reinterpret_cast<const git_blob*>( obj.get() );
+            const std::string_view data{reinterpret_cast<const char*>( git_blob_rawcontent( blob ) ),
+                                        static_cast<std::size_t>( git_blob_rawsize( blob ) )};
+            // the payload borrows the blob data, so it has to keep alive the blob and the repository
+            std::shared_ptr<const void> owner{
+                obj.release(), [repository = handle->repository, library = m_library]( git_object* ptr ) {
+                  git_object_free( ptr );
+                }};
+            out = payload_t{std::move( owner ), data};
           }
           return out;
         }
 
         std::chrono::system_clock::time_point commit_time( const char* commit_id ) const override {
-          auto obj = get_object( commit_id, "commit" );
+          auto handle = checkout();
+          auto obj    = get_object( *handle, commit_id, "commit" );
           return std::chrono::system_clock::from_time_t(
               git_commit_time( reinterpret_cast<git_commit*>( obj.get() ) ) );
         }
 
+        std::string content_id( const char* object_id ) const override {
+          auto    handle = checkout();
+          git_oid oid;
+          if ( has_path( object_id ) ) {
+            // no need to load the object to get its id
+            const git_tree*    root = nullptr;
+            git_tree_entry_ptr entry;
+            if ( !resolve( *handle, root, entry, object_id ) ) {
+              oid = entry ? *git_tree_entry_id( entry.get() ) : *git_tree_id( root );
+            } else if ( root || !revparse_id( *handle, oid, object_id ) ) { // the tag may contain ':' (see lookup)
+              return {};
+            }
+          } else if ( !revparse_id( *handle, oid, object_id ) ) {
+            return {};
+          }
+          std::string out( GIT_OID_HEXSZ, '\0' );
+          git_oid_fmt( out.data(), &oid );
+          return out;
+        }
+
+        std::size_t concurrency() const override { return m_handles.size(); }
+
+        /// Resolve the tag to the id of the commit (or the tree) it points to.
+        std::string pin( std::string_view tag ) const override {
+          auto       handle = checkout();
+          const auto obj    = get_object( *handle, std::string{tag}.c_str(), "tag" );
+          git_object* tmp   = nullptr;
+          if ( git_object_peel( &tmp, obj.get(), GIT_OBJ_COMMIT ) && git_object_peel( &tmp, obj.get(), GIT_OBJ_TREE ) )
+            throw std::runtime_error{fmt::format( "cannot pin tag {}: {}", tag, giterr_last()->message )};
+          git_object_ptr target{tmp};
+          std::string    out( GIT_OID_HEXSZ, '\0' );
+          git_oid_fmt( out.data(), git_object_id( target.get() ) );
+          return out;
+        }
+
+      protected:
+        /// Look for the IOVs entry directly in the subtrees, instead of resolving a path for each of them.
+        void classify_dirs( const char* object_id, std::vector<std::string>& dirs,
+                            std::vector<std::string>& conditions ) const override {
+          auto handle = checkout();
+          auto obj    = get_object( *handle, object_id );
+          auto tree   = reinterpret_cast<const git_tree*>( obj.get() );
+
+          std::vector<std::string> plain_dirs;
+          plain_dirs.reserve( dirs.size() );
+          for ( auto& dir : dirs ) {
+            bool is_condition = false;
+            if ( const auto entry = git_tree_entry_byname( tree, dir.c_str() ) ) {
+              git_tree* subtree = nullptr;
+              if ( !git_tree_lookup( &subtree, handle->repository.get(), git_tree_entry_id( entry ) ) ) {
+                is_condition = git_tree_entry_byname( subtree, Helpers::IOVs_file_name.data() );
+                git_tree_free( subtree );
+              }
+            }
+            ( is_condition ? conditions : plain_dirs ).emplace_back( std::move( dir ) );
+          }
+          dirs = std::move( plain_dirs );
+        }
+
       private:
-        git_object_ptr get_object( const char* commit_id, const std::string& obj_type = "object" ) const {
-          return git_call<git_object_ptr>( "cannot resolve " + obj_type, commit_id, git_revparse_single,
-                                           m_repository.get(), commit_id );
+        /// Apply the libgit2 settings of the options, leaving untouched those set to 0.
+        void set_library_options( const ConnectOptions& options ) const {
+          auto set = [this]( std::string_view name, std::size_t value, auto... args ) {
+            if ( !value ) return;
+            debug( [&]() { return fmt::format( "setting libgit2 option {} to {}", name, value ); } );
+            if ( UNLIKELY( git_libgit2_opts( args... ) < 0 ) )
+              throw std::runtime_error{fmt::format( "cannot set libgit2 option {}: {}", name, giterr_last()->message )};
+          };
+          set( "cache_max_size", options.git_cache_max_size, GIT_OPT_SET_CACHE_MAX_SIZE,
+               static_cast<ssize_t>( options.git_cache_max_size ) );
+          set( "cache_blob_limit", options.git_cache_blob_limit, GIT_OPT_SET_CACHE_OBJECT_LIMIT, GIT_OBJ_BLOB,
+               options.git_cache_blob_limit );
+          set( "mwindow_size", options.git_mwindow_size, GIT_OPT_SET_MWINDOW_SIZE, options.git_mwindow_size );
+          set( "mwindow_mapped_limit", options.git_mwindow_mapped_limit, GIT_OPT_SET_MWINDOW_MAPPED_LIMIT,
+               options.git_mwindow_mapped_limit );
+#if LIBGIT2_VER_MAJOR > 1 || ( LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 1 )
+          set( "mwindow_file_limit", options.git_mwindow_file_limit, GIT_OPT_SET_MWINDOW_FILE_LIMIT,
+               options.git_mwindow_file_limit );
+#else
+          if ( options.git_mwindow_file_limit ) warning( "mwindow_file_limit requires libgit2 >= 1.1, ignored" );
+#endif
+        }
+
+        /// Get exclusive access to one of the connections to the repository, opening it if needed.
+        pool_t::lease checkout() const {
+          auto handle = m_handles.acquire();
+          if ( UNLIKELY( !handle->repository ) ) {
+            info( [this]() { return fmt::format( "opening Git repository '{}'", m_repository_url ); } );
+            handle->repository = git_call<Helpers::git_repository_storage_t>(
+                "cannot open repository", m_repository_url, git_repository_open, m_repository_url.c_str() );
+            if ( UNLIKELY( !handle->repository ) )
+              throw std::runtime_error{"invalid Git repository: '" + m_repository_url + "'"};
+            ++m_open_handles;
+          }
+          return handle;
+        }
+
+        git_object_ptr get_object( handle_t& handle, const char* commit_id,
+                                   const std::string& obj_type = "object" ) const {
+          return git_call<git_object_ptr>(
+              "cannot resolve " + obj_type, commit_id,
+              [this, &handle]( git_object** out, const char* id ) { return lookup( handle, out, id ); }, commit_id );
+        }
+
+        /// Resolve an object id, with the same semantics as git_revparse_single.
+        ///
+        /// Ids in the form "<tag>:<path>" are resolved walking the path from the root tree of the tag,
+        /// which is resolved only once (per connection) and cached.
+        int lookup( handle_t& handle, git_object** out, const char* object_id ) const {
+          // no tag or no path: nothing to gain from the cache
+          if ( !has_path( object_id ) ) return git_revparse_single( out, handle.repository.get(), object_id );
+
+          const git_tree*    root = nullptr;
+          git_tree_entry_ptr entry;
+          if ( const int err = resolve( handle, root, entry, object_id ) ) {
+            // the tag may contain ':' (e.g. "HEAD^{/fix: something}"), so that it does not end where we split
+            return root ? err : git_revparse_single( out, handle.repository.get(), object_id );
+          }
+
+          return entry ? git_tree_entry_to_object( out, handle.repository.get(), entry.get() )
+                       : git_object_dup( out, reinterpret_cast<git_object*>( const_cast<git_tree*>( root ) ) );
+        }
+
+        /// Check if an object id is in the form "<tag>:<path>" (with a non empty tag).
+        static bool has_path( std::string_view object_id ) {
+          const auto pos = object_id.find_first_of( ':' );
+          return pos != object_id.npos && pos != 0;
+        }
+
+        /// Resolve an id in the form "<tag>:<path>" to the root tree of the tag and the entry for the path
+        /// (left empty if the path is empty, i.e. for the root tree itself).
+        ///
+        /// The tag is what precedes the first ':', and `root` is left null if it cannot be resolved.
+        int resolve( handle_t& handle, const git_tree*& root, git_tree_entry_ptr& entry, const char* object_id ) const {
+          const auto pos = std::string_view{object_id}.find_first_of( ':' );
+          if ( const int err = root_tree( handle, &root, {object_id, pos} ) ) return err;
+
+          const char* path = object_id + pos + 1;
+          if ( *path ) {
+            git_tree_entry* tmp = nullptr;
+            if ( const int err = git_tree_entry_bypath( &tmp, root, path ) ) return err;
+            entry.reset( tmp );
+          }
+          return 0;
+        }
+
+        /// Resolve an object id with git_revparse_single, returning true on success.
+        static bool revparse_id( handle_t& handle, git_oid& oid, const char* object_id ) {
+          git_object* tmp = nullptr;
+          if ( git_revparse_single( &tmp, handle.repository.get(), object_id ) ) return false;
+          git_object_ptr obj{tmp};
+          oid = *git_object_id( obj.get() );
+          return true;
+        }
+
+        /// Get the root tree for a tag, resolving it if not yet in the cache.
+        int root_tree( handle_t& handle, const git_tree** out, std::string_view tag ) const {
+          auto it = handle.trees.find( tag );
+          if ( it == handle.trees.end() ) {
+            git_object* tmp = nullptr;
+            if ( const int err = git_revparse_single( &tmp, handle.repository.get(), std::string{tag}.c_str() ) )
+              return err;
+            git_object_ptr obj{tmp};
+            tmp = nullptr;
+            if ( const int err = git_object_peel( &tmp, obj.get(), GIT_OBJ_TREE ) ) return err;
+            it = handle.trees.emplace( tag, git_object_ptr{tmp} ).first;
+          }
+          *out = reinterpret_cast<const git_tree*>( it->second.get() );
+          return 0;
         }
 
+        std::shared_ptr<Helpers::git_library> m_library;
+
         std::string m_repository_url;
 
-        mutable git_repository_ptr m_repository;
+        mutable pool_t                   m_handles;
+        mutable std::atomic<std::size_t> m_open_handles{0};
       };
 
       class FilesystemImpl : public DBImpl {
       public:
         FilesystemImpl( std::string_view root, std::shared_ptr<Logger> logger = nullptr )
-            : DBImpl{std::move( logger )}, m_root( root ) {
-          info( fmt::format( "using files from '{}'", m_root.string() ) );
+            : FilesystemImpl( root, std::move( logger ), ConnectOptions{} ) {}
+
+        FilesystemImpl( std::string_view root, std::shared_ptr<Logger> logger, const ConnectOptions& options )
+            : DBImpl{std::move( logger )}
+            , m_root( root )
+            , m_metadata{options.file_metadata_ttl}
+            , m_mmap_threshold{options.file_watch ? 0 : options.file_mmap_threshold} {
+          info( [this]() { return fmt::format( "using files from '{}'", m_root.string() ); } );
           if ( !is_directory( m_root ) ) throw std::runtime_error{"invalid path " + m_root.string()};
+          if ( options.file_watch ) {
+            info( "watching for changes" );
+            m_watch = std::make_unique<Helpers::watched_tree>(
+                [this]( const std::vector<std::string>& ids ) { forget_content_ids( ids ); } );
+          }
         }
 
         void disconnect() const override {}
 
         bool connected() const override { return true; }
 
+        const char* backend_name() const override { return "file"; }
+
         bool exists( const char* object_id ) const override {
           // return true for any tag name (i.e. id without a ':') and existing paths
           const std::string_view id{object_id};
-          return id.find_first_of( ':' ) == id.npos || fs::exists( to_path( id ) );
+          return id.find_first_of( ':' ) == id.npos || file_info( to_path( id ).string() ).exists();
         }
 
-        std::variant<std::string, dir_content> get( const char* object_id ) const override {
-          std::variant<std::string, dir_content> out;
-          const auto                             path = to_path( object_id );
+        std::variant<payload_t, dir_content> read_payload( const char* object_id ) const override {
+          using kind_t = Helpers::file_info::kind_t;
+          std::variant<payload_t, dir_content> out;
+          const auto                           path = to_path( object_id ).string();
 
-          debug( std::string{"accessing path "} + path.string() );
+          debug( [&path]() { return "accessing path " + path; } );
 
-          if ( is_directory( path ) ) {
+          // only one stat, possibly cached, to find out what we are looking at
+          const auto file = file_info( path );
+          if ( file.kind == kind_t::directory ) {
             debug( "found directory" );
 
             dir_content entries;
             entries.root = strip_tag( object_id );
-
-            for ( auto p : fs::directory_iterator( path ) ) {
-              ( is_directory( p.path() ) ? entries.dirs : entries.files ).emplace_back( p.path().filename() );
-            }
+            // watch before listing, not to miss changes
+            if ( m_watch ) m_watch->watch( path );
+            Helpers::list_directory( path.c_str(), entries.dirs, entries.files );
 
             out = std::move( entries );
-          } else if ( is_regular_file( path ) ) {
+          } else if ( file.kind == kind_t::regular ) {
             debug( "found regular file" );
 
-            std::ifstream stream{path.string()};
-            stream.seekg( 0, stream.end );
-            const auto size = stream.tellg();
-            stream.seekg( 0 );
-
-            std::string data( static_cast<std::size_t>( size ), 0 );
-            stream.read( data.data(), size );
-
-            out = std::move( data );
+            out = Helpers::read_file( path.c_str(), m_mmap_threshold );
           } else {
             throw std::runtime_error{std::string{"cannot resolve object "} + object_id};
           }
@@ -239,65 +750,103 @@ namespace GitCondDB {
           return std::chrono::time_point<std::chrono::system_clock>::max();
         }
 
+        // files may change at any time, so we can identify their content only if we watch them
+        std::string content_id( const char* object_id ) const override {
+          return m_watch ? m_watch->get( to_path( object_id ).string() ).id : std::string{};
+        }
+
+        bool has_content_ids() const override { return static_cast<bool>( m_watch ); }
+
       private:
-        inline fs::path to_path( std::string_view object_id ) const { return m_root / strip_tag( object_id ); }
+        inline fs::path to_path( std::string_view object_id ) const {
+          const auto path = strip_tag( object_id );
+          return path.empty() ? m_root : m_root / path;
+        }
+
+        Helpers::file_info file_info( const std::string& path ) const {
+          return m_watch ? m_watch->get( path ).info : m_metadata.get( path );
+        }
 
         fs::path m_root;
+
+        Helpers::metadata_cache                m_metadata;
+        std::size_t                            m_mmap_threshold;
+        std::unique_ptr<Helpers::watched_tree> m_watch;
       };
 
       class JSONImpl : public DBImpl {
         using json = nlohmann::json;
 
       public:
-        JSONImpl( std::string_view data, std::shared_ptr<Logger> logger = nullptr ) : DBImpl{std::move( logger )} {
+        /// Load the JSON data from a string or a file.
+        ///
+        /// If `build_index` is true, a table from paths to nodes is built during construction, so that
+        /// lookups do not need to walk the document.
+        JSONImpl( std::string_view data, std::shared_ptr<Logger> logger = nullptr, bool build_index = true )
+            : DBImpl{std::move( logger )} {
+          std::string text;
           if ( data.find_first_of( '{' ) != data.npos ) {
             info( "using JSON data from memory" );
-            m_json = json::parse( data );
+            text = data;
           } else if ( is_regular_file( fs::path( data ) ) ) {
-            info( fmt::format( "loading JSON data from '{}'", data ) );
-            std::ifstream stream{std::string{data}};
-            stream >> m_json;
+            info( [data]() { return fmt::format( "loading JSON data from '{}'", data ); } );
+            std::ifstream stream{std::string{data}, std::ios::binary};
+            text.assign( std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{} );
           } else {
             throw std::runtime_error{"invalid JSON"};
           }
+          m_json = std::make_shared<const json>( json::parse( text ) );
+          // the same document gives the same ids, also from another process
+          m_doc_id = fmt::format(
+              "{:08x}{:x}",
+              crc32( 0, reinterpret_cast<const Bytef*>( text.data() ), static_cast<uInt>( text.size() ) ),
+              text.size() );
+          if ( build_index ) {
+            std::string prefix;
+            add_to_index( prefix, *m_json );
+          }
         }
 
         void disconnect() const override {}
 
         bool connected() const override { return true; }
 
+        const char* backend_name() const override { return "json"; }
+
         bool exists( const char* object_id ) const override {
           // return true for any tag name (i.e. id without a ':') and existing paths
           const std::string_view id{object_id};
-          return id.find_first_of( ':' ) == id.npos || !m_json.value( to_path( object_id ), json{} ).is_null();
+          if ( id.find_first_of( ':' ) == id.npos ) return true;
+          const json* node = find_node( strip_tag( id ) );
+          return node && !node->is_null();
         }
 
-        std::variant<std::string, dir_content> get( const char* object_id ) const override {
-          std::variant<std::string, dir_content> out;
+        std::variant<payload_t, dir_content> read_payload( const char* object_id ) const override {
+          std::variant<payload_t, dir_content> out;
 
-          const auto path = to_path( object_id );
-          debug( fmt::format( "accessing entry '{}'", path.to_string() ) );
+          const auto path = strip_tag( object_id );
+          debug( [path]() { return fmt::format( "accessing entry '{}{}'", path.empty() ? "" : "/", path ); } );
 
-          auto obj = m_json.value( path, json{} );
+          const json* node = find_node( path );
 
-          if ( UNLIKELY( obj.is_null() ) ) {
+          if ( UNLIKELY( !node || node->is_null() ) ) {
             throw std::runtime_error{std::string{"cannot resolve object "} + object_id};
-          } else if ( obj.is_object() ) {
+          } else if ( node->is_object() ) {
             debug( "found object" );
 
             dir_content entries;
 
             entries.root = strip_tag( object_id );
 
-            // for(const auto& elem: )
-            for ( auto it = obj.begin(); it != obj.end(); ++it ) {
+            for ( auto it = node->begin(); it != node->end(); ++it ) {
               ( it.value().is_object() ? entries.dirs : entries.files ).emplace_back( it.key() );
             }
 
             out = std::move( entries );
-          } else if ( LIKELY( obj.is_string() ) ) {
+          } else if ( LIKELY( node->is_string() ) ) {
             debug( "found string" );
-            out = std::string{obj};
+            // the payload keeps the whole document alive
+            out = payload_t{std::shared_ptr<const void>{m_json, node}, node->get_ref<const std::string&>()};
           } else {
             throw std::runtime_error{std::string{"invalid type at "} + object_id};
           }
@@ -308,16 +857,83 @@ namespace GitCondDB {
           return std::chrono::time_point<std::chrono::system_clock>::max();
         }
 
-      private:
-        inline json::json_pointer to_path( std::string_view object_id ) const {
+        std::string content_id( const char* object_id ) const override {
+          // the data cannot change after loading, so the path of a node in the document identifies its content
           const auto path = strip_tag( object_id );
-          return json::json_pointer{path.empty() ? std::string{} : std::string{'/'} + std::string{path}};
+          return find_node( path ) ? fmt::format( "{}:{}", m_doc_id, path ) : std::string{};
         }
 
-        json m_json;
+      private:
+        /// Get the node at the given path (without the leading '/'), or nullptr if it does not exist.
+        ///
+        /// The path is interpreted as a JSON pointer.
+        const json* find_node( std::string_view path ) const {
+          if ( UNLIKELY( path.find_first_of( '~' ) != path.npos ) ) {
+            // escape sequences are rare enough to let json_pointer deal with them
+            try {
+              return &m_json->at( json::json_pointer{std::string{'/'} + std::string{path}} );
+            } catch ( json::exception& ) { return nullptr; }
+          }
+          if ( !m_index.empty() ) {
+            const auto it = m_index.find( path );
+            return it != m_index.end() ? it->second : nullptr;
+          }
+
+          const json* node = m_json.get();
+          if ( path.empty() ) return node;
+          std::string key;
+          while ( true ) {
+            const auto pos = path.find_first_of( '/' );
+            key.assign( path.substr( 0, pos ) );
+            if ( node->is_object() ) {
+              const auto it = node->find( key );
+              if ( it == node->end() ) return nullptr;
+              node = &*it;
+            } else if ( node->is_array() ) {
+              try {
+                node = &node->at( json::json_pointer{'/' + key} );
+              } catch ( json::exception& ) { return nullptr; }
+            } else {
+              return nullptr;
+            }
+            if ( pos == path.npos ) return node;
+            path.remove_prefix( pos + 1 );
+          }
+        }
+
+        /// Add to the index all nodes reachable from `node`, which is at path `prefix`.
+        ///
+        /// Entries whose name contains a '/' or a '~' are skipped, as they can only be reached with escape
+        /// sequences (and so are entries with an empty name at the top level, which cannot be reached).
+        void add_to_index( std::string& prefix, const json& node ) {
+          m_index.emplace( m_index_keys.emplace_back( prefix ), &node );
+          const auto size = prefix.size();
+          const auto add  = [this, &prefix, size]( std::string_view name, const json& child ) {
+            if ( size ) prefix += '/';
+            prefix += name;
+            add_to_index( prefix, child );
+            prefix.resize( size );
+          };
+          if ( node.is_object() ) {
+            for ( auto it = node.begin(); it != node.end(); ++it ) {
+              if ( ( !size && it.key().empty() ) || it.key().find_first_of( "/~" ) != std::string::npos ) continue;
+              add( it.key(), it.value() );
+            }
+          } else if ( node.is_array() ) {
+            for ( std::size_t i = 0; i < node.size(); ++i ) add( std::to_string( i ), node[i] );
+          }
+        }
+
+        std::shared_ptr<const json> m_json;
+        /// Checksum and size of the JSON text, prefix of the content ids.
+        std::string                 m_doc_id;
+
+        /// Table of nodes by path, if requested.
+        std::unordered_map<std::string_view, const json*> m_index;
+        std::deque<std::string>                           m_index_keys;
       };
     } // namespace details
-  }   // namespace v1
+  }   // namespace v2
 } // namespace GitCondDB
 
 #endif // DBIMPL_H
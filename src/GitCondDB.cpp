@@ -15,37 +15,33 @@
 #include "DBImpl.h"
 
 #include "iov_helpers.h"
+#include "path_helpers.h"
+#include "worker_helpers.h"
 
 #include "BasicLogger.h"
 
-#include <regex>
+#include <cmath>
+#include <future>
+#include <numeric>
+#include <optional>
 #include <sstream>
 #include <tuple>
+#include <unordered_map>
 
+#include <fmt/core.h>
 #include <nlohmann/json.hpp>
 
 #include <cassert>
 
-using namespace GitCondDB::v1;
+using namespace GitCondDB::v2;
 
 namespace {
-  /// helper to normalize relative paths
-  std::string normalize( std::string path ) {
-    // regex for entries to be removed, i.e. "/parent/../" and "/./"
-    static const std::regex ignored_re{"(/[^/]+/\\.\\./)|(/\\./)"};
-    std::string             old_path;
-    while ( old_path.length() != path.length() ) {
-      old_path.swap( path );
-      path = std::regex_replace( old_path, ignored_re, "/" );
-    }
-    return path;
-  }
-
-  inline std::string format_obj_id( const std::string& tag, const std::string& path ) {
-    return tag + ':' + normalize( path );
-  }
-  inline std::string format_obj_id( const std::string_view& tag, const std::string_view& path ) {
-    return format_obj_id( std::string{tag}, std::string{path} );
+  inline std::string format_obj_id( std::string_view tag, std::string_view path ) {
+    std::string obj_id;
+    obj_id.reserve( tag.size() + 1 + path.size() );
+    obj_id.append( tag ).append( 1, ':' ).append( path );
+    GitCondDB::Helpers::normalize_path( obj_id, tag.size() + 1 );
+    return obj_id;
   }
   inline std::string format_obj_id( const CondDB::Key& key ) { return format_obj_id( key.tag, key.path ); }
 
@@ -55,83 +51,684 @@ namespace {
   }
 } // namespace
 
+struct details::ThreadPool {
+  ThreadPool( std::size_t n_threads ) : pool{n_threads} {}
+  GitCondDB::Helpers::thread_pool pool;
+};
+
 CondDB::CondDB( std::unique_ptr<details::DBImpl> impl )
     : m_impl{std::move( impl )}, m_dir_converter{json_dir_converter} {
   assert( m_impl );
+  m_thread_pool = std::make_unique<details::ThreadPool>( m_impl->concurrency() );
 }
+CondDB::CondDB( CondDB&& ) = default;
 CondDB::~CondDB() {}
 
 void CondDB::set_logger( std::shared_ptr<Logger> logger ) { m_impl->set_logger( std::move( logger ) ); }
 
 Logger* CondDB::logger() const { return m_impl->logger(); }
 
-void CondDB::disconnect() const { m_impl->disconnect(); }
+void CondDB::disconnect() const {
+  m_impl->disconnect();
+  m_impl->drop_cached_payloads();
+}
 
 bool CondDB::connected() const { return m_impl->connected(); }
 
+void CondDB::set_payload_cache_size( std::size_t max_bytes ) { m_impl->payload_cache().set_max_bytes( max_bytes ); }
+
+std::size_t CondDB::payload_cache_size() const { return m_impl->payload_cache().max_bytes(); }
+
+CondDB::CacheStats CondDB::payload_cache_stats() const { return m_impl->payload_cache().stats(); }
+
+CondDB::Stats CondDB::stats() const {
+  const auto& stats = m_impl->stats();
+  auto        load  = []( const std::atomic<std::size_t>& counter ) {
+    return counter.load( std::memory_order_relaxed );
+  };
+
+  Stats out;
+  out.backend              = m_impl->backend_name();
+  out.lookups              = load( stats.lookups );
+  out.objects              = load( stats.objects );
+  out.bytes                = load( stats.bytes );
+  out.iov_cache.hits       = load( stats.iov_hits );
+  out.iov_cache.misses     = load( stats.iov_misses );
+  out.listing_cache.hits   = load( stats.listing_hits );
+  out.listing_cache.misses = load( stats.listing_misses );
+  out.payload_cache        = payload_cache_stats();
+  out.flat_iovs_cache      = m_impl->flat_iovs_cache().stats();
+  out.iov_entries_cache    = m_impl->iov_entries_cache().stats();
+  out.lookup_latency       = stats.lookup_latency.snapshot();
+  out.read_latency         = stats.read_latency.snapshot();
+  out.iov_parse_latency    = stats.iov_parse_latency.snapshot();
+  return out;
+}
+
+void CondDB::reset_stats() {
+  m_impl->stats().reset();
+  m_impl->payload_cache().reset_stats();
+  m_impl->flat_iovs_cache().reset_stats();
+  m_impl->iov_entries_cache().reset_stats();
+}
+
+std::string CondDB::Stats::dump() const {
+  std::string out;
+  auto        counter = [&out, this]( std::string_view name, std::size_t value ) {
+    out += fmt::format( "gitconddb_{}{{backend=\"{}\"}} {}\n", name, backend, value );
+  };
+  auto histogram = [&out, this]( std::string_view name, const LatencyHistogram& h ) {
+    std::size_t cumulative = 0;
+    for ( std::size_t i = 0; i < h.counts.size() && cumulative < h.count; ++i ) {
+      cumulative += h.counts[i];
+      out += fmt::format( "gitconddb_{}_seconds_bucket{{backend=\"{}\",le=\"{:g}\"}} {}\n", name, backend,
+                          std::ldexp( 2e-9, static_cast<int>( i ) ), cumulative );
+    }
+    out += fmt::format( "gitconddb_{}_seconds_bucket{{backend=\"{}\",le=\"+Inf\"}} {}\n", name, backend, h.count );
+    out += fmt::format( "gitconddb_{}_seconds_sum{{backend=\"{}\"}} {:g}\n", name, backend,
+                        std::chrono::duration<double>( h.total ).count() );
+    out += fmt::format( "gitconddb_{}_seconds_count{{backend=\"{}\"}} {}\n", name, backend, h.count );
+  };
+
+  counter( "lookups_total", lookups );
+  counter( "objects_read_total", objects );
+  counter( "bytes_read_total", bytes );
+  counter( "iov_cache_hits_total", iov_cache.hits );
+  counter( "iov_cache_misses_total", iov_cache.misses );
+  counter( "listing_cache_hits_total", listing_cache.hits );
+  counter( "listing_cache_misses_total", listing_cache.misses );
+  counter( "payload_cache_hits_total", payload_cache.hits );
+  counter( "payload_cache_misses_total", payload_cache.misses );
+  counter( "payload_cache_evictions_total", payload_cache.evictions );
+  counter( "payload_cache_entries", payload_cache.entries );
+  counter( "payload_cache_bytes", payload_cache.bytes );
+  counter( "flat_iovs_cache_hits_total", flat_iovs_cache.hits );
+  counter( "flat_iovs_cache_misses_total", flat_iovs_cache.misses );
+  counter( "flat_iovs_cache_evictions_total", flat_iovs_cache.evictions );
+  counter( "flat_iovs_cache_entries", flat_iovs_cache.entries );
+  counter( "flat_iovs_cache_bytes", flat_iovs_cache.bytes );
+  counter( "iov_entries_cache_hits_total", iov_entries_cache.hits );
+  counter( "iov_entries_cache_misses_total", iov_entries_cache.misses );
+  counter( "iov_entries_cache_evictions_total", iov_entries_cache.evictions );
+  counter( "iov_entries_cache_entries", iov_entries_cache.entries );
+  counter( "iov_entries_cache_bytes", iov_entries_cache.bytes );
+  histogram( "lookup_latency", lookup_latency );
+  histogram( "read_latency", read_latency );
+  histogram( "iov_parse_latency", iov_parse_latency );
+  return out;
+}
+
 std::tuple<std::string, CondDB::IOV> CondDB::get( const Key& key, const IOV& bounds ) const {
-  const std::string object_id = format_obj_id( key );
-  auto              data      = m_impl->get( object_id.c_str() );
-  if ( data.index() == 1 ) { // we got a directory
-    auto& content = std::get<1>( data );
-    if ( find( begin( content.files ), end( content.files ), "IOVs" ) != end( content.files ) ) {
-      auto info = GitCondDB::Helpers::get_key_iov( std::get<0>( m_impl->get( ( object_id + "/IOVs" ).c_str() ) ),
-                                                   key.time_point, bounds, m_reduce_iovs );
-      if ( LIKELY( std::get<1>( info ).valid() ) ) {
-        Key new_key = key;
-        new_key.path += '/' + std::get<0>( info );
-        return get( new_key, std::get<1>( info ) );
+  auto [payload, iov] = get_payload( key, bounds );
+  return {payload.str(), iov};
+}
+
+/// Objects loaded while looking up a key.
+struct CondDB::LookupMemo {
+  struct Node {
+    /// Index of the IOVs file if the object is a directory containing one.
+    std::shared_ptr<const GitCondDB::Helpers::IOVIndex> index;
+    /// Data of the file or converted content of the directory.
+    Payload payload;
+    bool    is_dir = false;
+  };
+
+  /// Read an object from the database (or the payload cache).
+  static Node load( const details::DBImpl& impl, const std::string& object_id, bool reduce_iovs,
+                    const dir_converter_t& dir_converter ) {
+    Node node;
+
+    auto&       cache = impl.payload_cache();
+    std::string payload_id;
+    if ( cache.enabled() ) {
+      payload_id = impl.content_id( object_id.c_str() );
+      if ( !payload_id.empty() ) {
+        if ( auto payload = cache.find( payload_id ) ) {
+          node.payload = std::move( *payload );
+          return node;
+        }
+      }
+    }
+
+    auto data = impl.get_payload( object_id.c_str() );
+    if ( data.index() == 1 ) { // we got a directory
+      auto& content = std::get<1>( data );
+      // same as impl.is_condition( object_id ), but using the listing we already have
+      if ( find( begin( content.files ), end( content.files ), GitCondDB::Helpers::IOVs_file_name ) !=
+           end( content.files ) ) {
+        node.index = impl.iov_index( fmt::format( "{}/{}", object_id, GitCondDB::Helpers::IOVs_file_name ).c_str(),
+                                     reduce_iovs );
       } else {
-        return info;
+        node.payload = Payload{dir_converter( *impl.conditions_listing( object_id.c_str(), std::move( content ) ) )};
+        node.is_dir  = true;
       }
     } else {
-      std::vector<std::string> dirs;
-      auto&                    files = content.files;
-      dirs.reserve( content.dirs.size() );
-      for ( auto& f : content.dirs ) {
-        ( m_impl->exists( ( object_id + '/' + f + "/IOVs" ).c_str() ) ? files : dirs ).emplace_back( std::move( f ) );
+      node.payload = std::move( std::get<0>( data ) );
+      if ( !payload_id.empty() ) cache.insert( std::move( payload_id ), node.payload, node.payload.size() );
+    }
+    return node;
+  }
+
+  /// Read an object through the memo if there is one, or into `local`.
+  static const Node* load( LookupMemo* memo, const details::DBImpl& impl, const std::string& object_id,
+                           bool reduce_iovs, const dir_converter_t& dir_converter, Node& local ) {
+    if ( !memo ) {
+      local = load( impl, object_id, reduce_iovs, dir_converter );
+      return &local;
+    }
+    auto it = memo->nodes.find( object_id );
+    if ( it == memo->nodes.end() ) {
+      it = memo->nodes.emplace( object_id, load( impl, object_id, reduce_iovs, dir_converter ) ).first;
+    }
+    return &it->second;
+  }
+
+  /// Get the flattened IOVs of an object, building them if needed, or nullptr if the condition cannot be
+  /// flattened (no content ids, payloads outside of it, or flattening disabled).
+  ///
+  /// Only conditions are flattened, but an empty table is cached for the other objects too, so that
+  /// they are not checked again.
+  static std::shared_ptr<const GitCondDB::Helpers::FlatIOVs> flat_iovs( const details::DBImpl& impl,
+                                                                        const std::string&     object_id,
+                                                                        bool                   reduce_iovs ) {
+    if ( UNLIKELY( !impl.flat_iovs_cache().enabled() ) ) return nullptr;
+    const auto id = impl.content_id( object_id.c_str() );
+    if ( id.empty() ) return nullptr;
+
+    auto flat = impl.find_flat_iovs( id, reduce_iovs );
+    if ( !flat ) {
+      auto                                           table = std::make_shared<GitCondDB::Helpers::FlatIOVs>();
+      std::string                                    iovs_id;
+      std::unordered_map<std::string, std::uint32_t> key_ids;
+      // an empty table (not a condition, or one that cannot be flattened) means using the nested tables
+      if ( const auto iovs_file = impl.find_iovs_file( object_id, iovs_id );
+           !iovs_file.empty() &&
+           !flatten( impl, reduce_iovs, object_id, object_id, iovs_file, std::move( iovs_id ), {}, *table, key_ids ) )
+        *table = {};
+      flat = table;
+      impl.store_flat_iovs( id, reduce_iovs, std::move( table ) );
+    }
+    return flat->since.empty() ? nullptr : flat;
+  }
+
+  /// Look up a key in the flattened IOVs of the condition, building them if needed.
+  ///
+  /// Nothing is returned if the path is not a condition, if the condition cannot be flattened (see
+  /// flat_iovs), or if the time point is not covered by a payload.
+  /// If `payload_id` is not null, it is set to the content id of the payload.
+  static std::optional<std::tuple<Payload, IOV>> load_flat( LookupMemo* memo, const details::DBImpl& impl,
+                                                             const Key& key, const IOV& bounds, bool reduce_iovs,
+                                                             const dir_converter_t& dir_converter,
+                                                             std::string*           payload_id ) {
+    if ( UNLIKELY( !bounds.contains( key.time_point ) ) ) return std::nullopt;
+    const auto flat = flat_iovs( impl, format_obj_id( key ), reduce_iovs );
+    if ( !flat ) return std::nullopt;
+    return load_flat( memo, impl, *flat, key, bounds, reduce_iovs, dir_converter, payload_id );
+  }
+
+  /// Look up a key in the given flattened IOVs of the condition.
+  static std::optional<std::tuple<Payload, IOV>>
+  load_flat( LookupMemo* memo, const details::DBImpl& impl, const GitCondDB::Helpers::FlatIOVs& flat, const Key& key,
+             const IOV& bounds, bool reduce_iovs, const dir_converter_t& dir_converter, std::string* payload_id ) {
+    const auto [suffix, iov] = flat.find( key.time_point );
+    if ( !suffix ) return std::nullopt;
+    Node        local;
+    const auto  leaf_id = format_obj_id( key.tag, key.path + *suffix );
+    const auto* node    = load( memo, impl, leaf_id, reduce_iovs, dir_converter, local );
+    if ( UNLIKELY( node->index != nullptr ) ) return std::nullopt;
+    if ( payload_id ) *payload_id = impl.content_id( leaf_id.c_str() );
+    return std::tuple<Payload, IOV>{node->payload, node->is_dir ? IOV{} : iov.intersect( bounds )};
+  }
+
+  /// Append to `flat` the segments of the IOVs table of the directory `object_id` within `bounds`,
+  /// recursing into the nested tables.
+  ///
+  /// Returns false if a payload or a nested table is outside of the condition `root`, as it would not
+  /// be covered by the content id of the condition.
+  static bool flatten( const details::DBImpl& impl, bool reduce_iovs, const std::string& root,
+                       const std::string& object_id, const std::string& iovs_file, std::string iovs_id,
+                       const IOV& bounds, GitCondDB::Helpers::FlatIOVs& flat,
+                       std::unordered_map<std::string, std::uint32_t>& key_ids ) {
+    using FlatIOVs   = GitCondDB::Helpers::FlatIOVs;
+    const auto index = impl.iov_index( iovs_file.c_str(), reduce_iovs, std::move( iovs_id ) );
+
+    const auto first = index->empty() ? bounds.until : std::min( index->since( 0 ), bounds.until );
+    if ( bounds.since < first ) {
+      flat.since.push_back( bounds.since );
+      flat.key_ids.push_back( FlatIOVs::no_payload );
+    }
+    for ( std::size_t i = 0; i < index->size(); ++i ) {
+      const auto iov = index->iov( i ).intersect( bounds );
+      if ( !iov.valid() ) continue;
+
+      auto sub_id = object_id + '/';
+      sub_id.append( index->key( i ) );
+      GitCondDB::Helpers::normalize_path( sub_id );
+      if ( sub_id.size() <= root.size() || sub_id.compare( 0, root.size(), root ) || sub_id[root.size()] != '/' )
+        return false;
+
+      std::string sub_iovs_id;
+      if ( const auto sub_iovs = impl.find_iovs_file( sub_id, sub_iovs_id ); !sub_iovs.empty() ) {
+        if ( !flatten( impl, reduce_iovs, root, sub_id, sub_iovs, std::move( sub_iovs_id ), iov, flat, key_ids ) )
+          return false;
+      } else {
+        auto [key, added] = key_ids.emplace( sub_id.substr( root.size() ), flat.keys.size() );
+        if ( added ) flat.keys.push_back( key->first );
+        flat.since.push_back( iov.since );
+        flat.key_ids.push_back( key->second );
+      }
+    }
+    return true;
+  }
+
+  std::unordered_map<std::string, Node> nodes;
+};
+
+std::tuple<CondDB::Payload, CondDB::IOV> CondDB::get_payload( const Key& key, const IOV& bounds ) const {
+  auto result = lookup( *m_impl, m_reduce_iovs, m_dir_converter, key, bounds, nullptr );
+  if ( UNLIKELY( prefetch() ) ) prefetch_after( key.tag, key.path, std::get<1>( result ) );
+  return result;
+}
+
+std::tuple<CondDB::Payload, CondDB::IOV> CondDB::lookup( const details::DBImpl& impl, bool reduce_iovs,
+                                                         const dir_converter_t& dir_converter, const Key& key,
+                                                         const IOV& bounds, LookupMemo* memo,
+                                                         std::string* payload_id ) {
+  auto& stats = impl.stats();
+  stats.count( stats.lookups );
+  GitCondDB::Helpers::scoped_timer timer{stats.lookup_latency};
+
+  // conditions are looked up in their flattened IOVs if possible
+  if ( auto result = LookupMemo::load_flat( memo, impl, key, bounds, reduce_iovs, dir_converter, payload_id ) )
+    return *result;
+
+  // otherwise we follow the chain of nested IOVs tables down to the payload
+  Key current_key    = key;
+  IOV current_bounds = bounds;
+  while ( true ) {
+    const std::string object_id = format_obj_id( current_key );
+
+    LookupMemo::Node        local_node;
+    const LookupMemo::Node* node = LookupMemo::load( memo, impl, object_id, reduce_iovs, dir_converter, local_node );
+
+    if ( node->index ) {
+      const auto [sub_key, iov] = node->index->find( current_key.time_point, current_bounds );
+      if ( UNLIKELY( !iov.valid() ) ) return {Payload{std::string{sub_key}}, iov};
+      current_key.path += '/';
+      current_key.path += sub_key;
+      current_bounds = iov;
+    } else {
+      if ( payload_id ) *payload_id = impl.content_id( object_id.c_str() );
+      return {node->payload, node->is_dir ? IOV{} : current_bounds};
+    }
+  }
+}
+
+namespace {
+  /// Collect the paths of the conditions (directories with an IOVs file) under `path`.
+  void collect_conditions( const details::DBImpl& impl, std::string_view tag, const std::string& path,
+                           std::vector<std::string>& conditions ) {
+    const auto object_id = format_obj_id( tag, path );
+    if ( impl.is_condition( object_id ) ) {
+      conditions.push_back( path );
+      return;
+    }
+    auto data = impl.get_payload( object_id.c_str() );
+    if ( data.index() == 0 ) return; // a plain file
+    auto&      content = std::get<1>( data );
+    const auto files   = content.files;
+    const auto listing = impl.conditions_listing( object_id.c_str(), std::move( content ) );
+
+    auto sub_path = [&path]( const std::string& name ) { return path.empty() ? name : path + '/' + name; };
+    for ( const auto& name : listing->files ) {
+      // the conditions are the entries moved from the directories to the files
+      if ( find( begin( files ), end( files ), name ) == end( files ) ) conditions.push_back( sub_path( name ) );
+    }
+    for ( const auto& name : listing->dirs ) collect_conditions( impl, tag, sub_path( name ), conditions );
+  }
+} // namespace
+
+std::size_t CondDB::preload( std::string_view tag, std::string_view prefix, const IOV& range,
+                             std::size_t threads ) const {
+  if ( UNLIKELY( !range.valid() || !m_impl->exists( format_obj_id( tag, prefix ).c_str() ) ) ) return 0;
+
+  std::vector<std::string> conditions;
+  collect_conditions( *m_impl, tag, std::string{prefix}, conditions );
+
+  // look up each condition at the beginning of each of its IOVs within the range
+  auto preload_conditions = [this, tag = std::string{tag}, &conditions, &range]( std::size_t first,
+                                                                                  std::size_t last ) {
+    std::size_t count = 0;
+    for ( auto i = first; i < last; ++i ) {
+      LookupMemo memo;
+      for ( const auto& entry : iovs( tag, conditions[i], range ) ) {
+        lookup( *m_impl, m_reduce_iovs, m_dir_converter, {tag, conditions[i], std::get<0>( entry ).since}, {},
+                &memo );
+        ++count;
       }
-      content.dirs = std::move( dirs );
-      std::sort( begin( content.files ), end( content.files ) );
-      std::sort( begin( content.dirs ), end( content.dirs ) );
-      return {m_dir_converter( content ), {}};
     }
+    return count;
+  };
+
+  if ( !threads ) threads = m_impl->concurrency();
+  threads = std::max<std::size_t>( std::min( threads, conditions.size() ), 1 );
+  if ( threads == 1 ) return preload_conditions( 0, conditions.size() );
+
+  std::vector<std::future<std::size_t>> tasks;
+  for ( std::size_t task = 0; task < threads; ++task ) {
+    tasks.push_back( std::async( std::launch::async, preload_conditions, task * conditions.size() / threads,
+                                 ( task + 1 ) * conditions.size() / threads ) );
+  }
+  std::size_t count = 0;
+  for ( auto& task : tasks ) count += task.get();
+  return count;
+}
+
+CondDB::TagView CondDB::pin( std::string_view tag ) const { return {*this, std::string{tag}, m_impl->pin( tag )}; }
+
+std::vector<std::tuple<CondDB::Payload, CondDB::IOV>> CondDB::get_many( const std::vector<Key>& keys ) const {
+  return lookup_many( *m_impl, m_reduce_iovs, m_dir_converter, keys );
+}
+
+std::vector<std::tuple<CondDB::Payload, CondDB::IOV>>
+CondDB::lookup_many( const details::DBImpl& impl, bool reduce_iovs, const dir_converter_t& dir_converter,
+                     const std::vector<Key>& keys ) {
+  // process the keys sorted by tag and path, so that those sharing a prefix are looked up together
+  std::vector<std::size_t> order( keys.size() );
+  std::iota( begin( order ), end( order ), std::size_t{0} );
+  std::sort( begin( order ), end( order ), [&keys]( std::size_t a, std::size_t b ) {
+    return std::tie( keys[a].tag, keys[a].path ) < std::tie( keys[b].tag, keys[b].path );
+  } );
+
+  LookupMemo                            memo;
+  std::vector<std::tuple<Payload, IOV>> out( keys.size() );
+  for ( const auto i : order ) out[i] = lookup( impl, reduce_iovs, dir_converter, keys[i], {}, &memo );
+  return out;
+}
+
+void CondDB::execute( std::function<void()> task ) const {
+  if ( m_executor ) {
+    m_executor( std::move( task ) );
   } else {
-    return {std::get<0>( data ), bounds};
+    m_thread_pool->pool.submit( std::move( task ) );
+  }
+}
+
+// the tasks must not refer to this instance, which may be moved
+
+std::future<std::tuple<std::string, CondDB::IOV>> CondDB::get_async( Key key ) const {
+  auto task = std::make_shared<std::packaged_task<std::tuple<std::string, IOV>()>>(
+      [impl = m_impl.get(), reduce_iovs = m_reduce_iovs, dir_converter = m_dir_converter, key = std::move( key )]() {
+        auto [payload, iov] = lookup( *impl, reduce_iovs, dir_converter, key, {}, nullptr );
+        return std::tuple<std::string, IOV>{payload.str(), iov};
+      } );
+  auto result = task->get_future();
+  execute( [task]() { ( *task )(); } );
+  return result;
+}
+
+std::future<std::vector<std::tuple<CondDB::Payload, CondDB::IOV>>>
+CondDB::get_many_async( std::vector<Key> keys ) const {
+  auto task = std::make_shared<std::packaged_task<std::vector<std::tuple<Payload, IOV>>()>>(
+      [impl = m_impl.get(), reduce_iovs = m_reduce_iovs, dir_converter = m_dir_converter,
+       keys = std::move( keys )]() { return lookup_many( *impl, reduce_iovs, dir_converter, keys ); } );
+  auto result = task->get_future();
+  execute( [task]() { ( *task )(); } );
+  return result;
+}
+
+struct CondDB::Cursor::Level {
+  /// Path of the directory containing the IOVs file.
+  std::string path;
+  /// Parsed IOVs file.
+  std::shared_ptr<const GitCondDB::Helpers::IOVIndex> index;
+  /// Boundaries of the IOVs in the table (from the parent tables).
+  IOV bounds;
+  /// Position of the last found entry in the table.
+  std::size_t position = 0;
+  /// Flattened IOVs of the condition, used instead of the nested tables if set (for the only level).
+  std::shared_ptr<const GitCondDB::Helpers::FlatIOVs> flat;
+};
+
+CondDB::Cursor::Cursor( const CondDB& db, std::string_view tag, std::string_view path )
+    : m_db{&db}, m_tag{tag}, m_path{path} {}
+
+CondDB::Cursor::Cursor( Cursor&& ) = default;
+CondDB::Cursor& CondDB::Cursor::operator=( Cursor&& ) = default;
+CondDB::Cursor::~Cursor()                             = default;
+
+std::tuple<CondDB::Payload, CondDB::IOV> CondDB::Cursor::at( time_point_t t ) {
+  if ( LIKELY( m_iov.valid() && m_iov.contains( t ) ) ) return {m_payload, m_iov};
+
+  auto& stats = m_db->m_impl->stats();
+  stats.count( stats.lookups );
+  GitCondDB::Helpers::scoped_timer timer{stats.lookup_latency};
+
+  // use the flattened IOVs of the condition if possible (checked on the first lookup)
+  if ( m_levels.empty() ) {
+    if ( auto flat = LookupMemo::flat_iovs( *m_db->m_impl, format_obj_id( m_tag, m_path ), m_db->m_reduce_iovs ) )
+      m_levels.push_back( {m_path, nullptr, {}, 0, std::move( flat )} );
+  }
+  if ( !m_levels.empty() && m_levels.front().flat ) {
+    if ( auto result = LookupMemo::load_flat( nullptr, *m_db->m_impl, *m_levels.front().flat, {m_tag, m_path, t}, {},
+                                              m_db->m_reduce_iovs, m_db->m_dir_converter, nullptr ) ) {
+      std::tie( m_payload, m_iov ) = std::move( *result );
+      if ( UNLIKELY( m_db->prefetch() ) ) m_db->prefetch_after( m_tag, m_path, m_iov );
+      return {m_payload, m_iov};
+    }
+    m_levels.clear(); // not covered by a payload: fall back on the nested tables
+  }
+
+  // go back to the innermost table that covers t
+  while ( !m_levels.empty() && !m_levels.back().bounds.contains( t ) ) m_levels.pop_back();
+
+  std::string path      = m_path;
+  IOV         bounds    = {};
+  bool        need_load = m_levels.empty();
+  while ( true ) {
+    if ( need_load ) {
+      const auto object_id = format_obj_id( m_tag, path );
+      auto       node = LookupMemo::load( *m_db->m_impl, object_id, m_db->m_reduce_iovs, m_db->m_dir_converter );
+      if ( !node.index ) {
+        m_payload = std::move( node.payload );
+        m_iov     = node.is_dir ? IOV{} : bounds;
+        break;
+      }
+      m_levels.push_back( {std::move( path ), std::move( node.index ), bounds, 0, nullptr} );
+    }
+    need_load = true;
+
+    auto& level               = m_levels.back();
+    const auto [sub_key, iov] = level.index->find( t, level.bounds, level.position );
+    if ( UNLIKELY( !iov.valid() ) ) {
+      m_payload = Payload{std::string{sub_key}};
+      m_iov     = iov;
+      break;
+    }
+    path = level.path + '/';
+    path += sub_key;
+    bounds = iov;
+  }
+  if ( UNLIKELY( m_db->prefetch() ) ) m_db->prefetch_after( m_tag, m_path, m_iov );
+  return {m_payload, m_iov};
+}
+
+struct details::Prefetcher {
+  GitCondDB::Helpers::background_worker worker;
+};
+
+void CondDB::set_prefetch( bool value ) {
+  if ( !value ) {
+    m_prefetcher.reset();
+  } else if ( !m_prefetcher ) {
+    m_prefetcher = std::make_unique<details::Prefetcher>();
   }
 }
 
+void CondDB::prefetch_after( std::string_view tag, std::string_view path, const IOV& iov ) const {
+  if ( !iov.valid() || iov.until == IOV::max() || !m_impl->payload_cache().enabled() ) return;
+  Key next{std::string{tag}, std::string{path}, iov.until};
+  // the task must not refer to this instance, which may be moved
+  auto task_id = format_obj_id( next ) + '@' + std::to_string( next.time_point );
+  m_prefetcher->worker.submit( std::move( task_id ), [impl = m_impl.get(), reduce_iovs = m_reduce_iovs,
+                                                      dir_converter = m_dir_converter, next = std::move( next )]() {
+    try {
+      lookup( *impl, reduce_iovs, dir_converter, next, {}, nullptr );
+    } catch ( std::exception& err ) {
+      impl->debug( [&]() {
+        return fmt::format( "failed to prefetch {}:{} at {}: {}", next.tag, next.path, next.time_point, err.what() );
+      } );
+    }
+  } );
+}
+
 std::chrono::system_clock::time_point CondDB::commit_time( const std::string& commit_id ) const {
   return m_impl->commit_time( commit_id.c_str() );
 }
 
-CondDB GitCondDB::v1::connect( std::string_view repository, std::shared_ptr<Logger> logger ) {
+CondDB GitCondDB::v2::connect( std::string_view repository, std::shared_ptr<Logger> logger ) {
+  return connect( repository, ConnectOptions{}, std::move( logger ) );
+}
+
+CondDB GitCondDB::v2::connect( std::string_view repository, const ConnectOptions& options,
+                               std::shared_ptr<Logger> logger ) {
   if ( !logger ) logger = std::make_shared<BasicLogger>();
 
+  std::unique_ptr<details::DBImpl> impl;
   if ( repository.substr( 0, 5 ) == "file:" ) {
-    return {std::make_unique<details::FilesystemImpl>( repository.substr( 5 ), std::move( logger ) )};
+    impl = std::make_unique<details::FilesystemImpl>( repository.substr( 5 ), std::move( logger ), options );
   } else if ( repository.substr( 0, 5 ) == "json:" ) {
-    return {std::make_unique<details::JSONImpl>( repository.substr( 5 ), std::move( logger ) )};
+    impl = std::make_unique<details::JSONImpl>( repository.substr( 5 ), std::move( logger ), options.json_index );
   } else if ( repository.substr( 0, 4 ) == "git:" ) {
-    return {std::make_unique<details::GitImpl>( repository.substr( 4 ), std::move( logger ) )};
+    impl = std::make_unique<details::GitImpl>( repository.substr( 4 ), std::move( logger ), options );
   } else {
-    return {std::make_unique<details::GitImpl>( repository, std::move( logger ) )};
+    impl = std::make_unique<details::GitImpl>( repository, std::move( logger ), options );
   }
+  impl->set_decompress( options.decompress_payloads );
+  impl->flat_iovs_cache().set_max_bytes( options.flat_iovs_cache_size );
+  impl->iov_entries_cache().set_max_bytes( options.iov_entries_cache_size );
+  return {std::move( impl )};
 }
 
 void CondDB::iov_boundaries_accumulate( const std::string& object_id, const CondDB::IOV& limits,
-                                        std::vector<std::pair<CondDB::IOV, std::string>>& acc ) const {
+                                        std::vector<std::pair<CondDB::IOV, std::string>>& acc,
+                                        const std::size_t concurrency ) const {
   // get all iovs in the current obj_id
-  auto iovs_file = object_id + "/IOVs";
-  if ( !m_impl->exists( iovs_file.c_str() ) ) {
+  std::string iovs_id;
+  const auto  iovs_file = m_impl->find_iovs_file( object_id, iovs_id );
+  if ( iovs_file.empty() ) {
     acc.emplace_back( limits, object_id );
+    return;
+  }
+
+  // the entries of a directory depend only on its content, unless they refer to objects outside of it
+  auto memo_key = m_impl->content_id( object_id.c_str() );
+  if ( !memo_key.empty() ) {
+    memo_key.append( 1, ':' ).append( std::to_string( limits.since ) );
+    memo_key.append( 1, '-' ).append( std::to_string( limits.until ) );
+    if ( const auto entries = m_impl->find_iov_entries( memo_key ) ) {
+      for ( const auto& [iov, suffix] : *entries ) acc.emplace_back( iov, object_id + suffix );
+      return;
+    }
+  }
+
+  std::vector<std::pair<CondDB::IOV, std::string>> sub_ids;
+  {
+    const auto index = m_impl->iov_index( iovs_file.c_str(), false, std::move( iovs_id ) );
+    for ( std::size_t i = 0; i < index->size(); ++i ) {
+      const auto iov = index->iov( i );
+      if ( limits.overlaps( iov ) ) {
+        auto sub_id = object_id + '/';
+        sub_id.append( index->key( i ) );
+        GitCondDB::Helpers::normalize_path( sub_id );
+        sub_ids.emplace_back( limits.intersect( iov ), std::move( sub_id ) );
+      }
+    }
+  }
+
+  const auto first = acc.size();
+  if ( concurrency > 1 && sub_ids.size() > 1 ) {
+    // explore contiguous chunks of entries in parallel (the first one in this thread, the others in the
+    // pool of threads of the connection), so that the results can just be concatenated
+    using entries_t    = details::DBImpl::iov_entries_t;
+    const auto n_tasks = std::min( concurrency, sub_ids.size() );
+    auto       chunk   = [this, &sub_ids, n_tasks]( std::size_t task ) {
+      entries_t out;
+      for ( auto i = task * sub_ids.size() / n_tasks; i < ( task + 1 ) * sub_ids.size() / n_tasks; ++i )
+        iov_boundaries_accumulate( sub_ids[i].second, sub_ids[i].first, out );
+      return out;
+    };
+    std::vector<std::future<entries_t>> tasks;
+    for ( std::size_t task = 1; task < n_tasks; ++task ) {
+      auto packaged = std::make_shared<std::packaged_task<entries_t()>>( [&chunk, task]() { return chunk( task ); } );
+      tasks.push_back( packaged->get_future() );
+      m_thread_pool->pool.submit( [packaged]() { ( *packaged )(); } );
+    }
+    std::exception_ptr error;
+    try {
+      auto out = chunk( 0 );
+      acc.insert( end( acc ), std::make_move_iterator( begin( out ) ), std::make_move_iterator( end( out ) ) );
+    } catch ( ... ) { error = std::current_exception(); }
+    // the tasks refer to local variables, so we must wait for all of them before leaving
+    for ( auto& task : tasks ) {
+      try {
+        auto out = task.get();
+        acc.insert( end( acc ), std::make_move_iterator( begin( out ) ), std::make_move_iterator( end( out ) ) );
+      } catch ( ... ) {
+        if ( !error ) error = std::current_exception();
+      }
+    }
+    if ( error ) std::rethrow_exception( error );
   } else {
-    const auto tmp = Helpers::parse_IOVs_keys( std::get<0>( m_impl->get( iovs_file.c_str() ) ) );
-    std::for_each( begin( tmp ), end( tmp ), [&acc, &object_id, &limits, this]( const auto& entry ) {
-      if ( limits.overlaps( entry.first ) )
-        iov_boundaries_accumulate( normalize( object_id + '/' + entry.second ), limits.intersect( entry.first ), acc );
-    } );
+    for ( const auto& [sub_limits, sub_id] : sub_ids ) iov_boundaries_accumulate( sub_id, sub_limits, acc );
   }
+
+  if ( !memo_key.empty() ) {
+    auto entries = std::make_shared<details::DBImpl::iov_entries_t>();
+    entries->reserve( acc.size() - first );
+    for ( auto entry = begin( acc ) + first; entry != end( acc ); ++entry ) {
+      std::string_view suffix{entry->second};
+      if ( suffix.substr( 0, object_id.size() ) != object_id ) return;
+      suffix.remove_prefix( object_id.size() );
+      if ( suffix.empty() || suffix.front() != '/' || suffix.find( "/../" ) != suffix.npos ||
+           ( suffix.size() >= 3 && suffix.substr( suffix.size() - 3 ) == "/.." ) )
+        return;
+      entries->emplace_back( entry->first, suffix );
+    }
+    m_impl->store_iov_entries( std::move( memo_key ), std::move( entries ) );
+  }
+}
+
+std::vector<std::tuple<CondDB::IOV, std::string>> CondDB::iovs( std::string_view tag, std::string_view path,
+                                                               const IOV& boundaries ) const {
+  std::vector<std::tuple<CondDB::IOV, std::string>> out;
+
+  const auto object_id = format_obj_id( tag, path );
+
+  if ( UNLIKELY( !boundaries.valid() || !m_impl->exists( object_id.c_str() ) ) ) return out;
+
+  std::vector<std::pair<CondDB::IOV, std::string>> tmp;
+  iov_boundaries_accumulate( object_id, boundaries, tmp, m_impl->concurrency() );
+  out.reserve( tmp.size() );
+  for ( auto& [iov, id] : tmp ) out.emplace_back( iov, id.substr( tag.size() + 1 ) );
+
+  return out;
+}
+
+std::tuple<CondDB::Payload, CondDB::IOV, std::string> CondDB::get_payload_with_id( const Key& key ) const {
+  std::string id;
+  auto [payload, iov] = lookup( *m_impl, m_reduce_iovs, m_dir_converter, key, {}, nullptr, &id );
+  return {std::move( payload ), iov, std::move( id )};
+}
+
+bool CondDB::has_content_ids() const { return m_impl->has_content_ids(); }
+
+std::string CondDB::content_id( const Key& key ) const {
+  if ( UNLIKELY( key.time_point == IOV::max() ) ) return {};
+  // the IOVs of the key resolve the nested tables down to the payload
+  const auto payloads = iovs( key.tag, key.path, {key.time_point, key.time_point + 1} );
+  if ( payloads.empty() ) return {};
+  return m_impl->content_id( format_obj_id( key.tag, std::get<1>( payloads.front() ) ).c_str() );
 }
 
 std::vector<CondDB::time_point_t> CondDB::iov_boundaries( std::string_view tag, std::string_view path,
@@ -143,7 +740,7 @@ std::vector<CondDB::time_point_t> CondDB::iov_boundaries( std::string_view tag,
   if ( UNLIKELY( !boundaries.valid() || !m_impl->exists( object_id.c_str() ) ) ) return out;
 
   std::vector<std::pair<CondDB::IOV, std::string>> tmp;
-  iov_boundaries_accumulate( object_id, boundaries, tmp );
+  iov_boundaries_accumulate( object_id, boundaries, tmp, m_impl->concurrency() );
   std::transform( begin( tmp ), end( tmp ), back_inserter( out ),
                   []( const auto& entry ) { return entry.first.since; } );
 
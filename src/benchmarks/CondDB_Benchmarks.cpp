@@ -0,0 +1,198 @@
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include "GitCondDB.h"
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+#include <git2.h>
+
+#include <optional>
+#include <random>
+
+using namespace GitCondDB::v2;
+
+namespace {
+  /// parameters of the synthetic repository generated by tests/prepare_bench_data.py
+  constexpr std::size_t          n_conditions       = 200;
+  constexpr std::size_t          conditions_per_dir = 10;
+  constexpr std::size_t          n_iovs             = 20;
+  constexpr CondDB::time_point_t iov_length         = 100;
+  constexpr std::size_t          n_tags             = 3;
+
+  /// the same data for the three backends (range(0) in the benchmarks)
+  const char* backends[] = {"git:bench_data/synthetic/repo.git", "file:bench_data/synthetic/repo",
+                            "json:bench_data/synthetic/repo.json"};
+
+  void all_backends( benchmark::internal::Benchmark* b ) { b->ArgName( "backend" )->DenseRange( 0, 2 ); }
+
+  CondDB connect_backend( const benchmark::State& state, std::size_t handles = 1 ) {
+    ConnectOptions options;
+    options.repository_handles = handles;
+    return connect( backends[state.range( 0 )], options );
+  }
+
+  const std::string last_tag = "v" + std::to_string( n_tags - 1 );
+
+  std::string condition_path( std::size_t index ) {
+    return fmt::format( "Conditions/dir{:03}/Cond{}", index / conditions_per_dir, index % conditions_per_dir );
+  }
+
+  /// random keys over all the conditions and IOVs (always the same sequence)
+  const std::vector<CondDB::Key>& random_keys() {
+    static const auto keys = []() {
+      std::mt19937_64                                     gen{42};
+      std::uniform_int_distribution<std::size_t>          condition( 0, n_conditions - 1 );
+      std::uniform_int_distribution<CondDB::time_point_t> time_point( 0, n_iovs * iov_length - 1 );
+      std::vector<CondDB::Key>                            out;
+      for ( int i = 0; i < 1000; ++i ) {
+        auto path = condition_path( condition( gen ) );
+        out.push_back( {last_tag, std::move( path ), time_point( gen )} );
+      }
+      return out;
+    }();
+    return keys;
+  }
+} // namespace
+
+static void CondDB_get( benchmark::State& state ) {
+  auto        db   = connect_backend( state );
+  const auto& keys = random_keys();
+  std::size_t i    = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( keys[i++ % keys.size()] ) ); }
+}
+BENCHMARK( CondDB_get )->Apply( all_backends );
+
+/// Throughput of concurrent lookups (with one repository handle per thread for Git).
+static void CondDB_get_threads( benchmark::State& state ) {
+  static std::optional<CondDB> db;
+  if ( state.thread_index() == 0 ) db.emplace( connect_backend( state, state.threads() ) );
+  const auto& keys = random_keys();
+  std::size_t i    = state.thread_index();
+  for ( auto _ : state ) {
+    benchmark::DoNotOptimize( db->get( keys[i % keys.size()] ) );
+    i += state.threads();
+  }
+  if ( state.thread_index() == 0 ) db.reset();
+}
+BENCHMARK( CondDB_get_threads )->Apply( all_backends )->ThreadRange( 1, 8 )->UseRealTime();
+
+/// Listing of a directory of conditions.
+static void CondDB_listing( benchmark::State& state ) {
+  auto        db = connect_backend( state );
+  std::size_t i  = 0;
+  for ( auto _ : state ) {
+    const auto dir = fmt::format( "Conditions/dir{:03}", i++ % ( n_conditions / conditions_per_dir ) );
+    benchmark::DoNotOptimize( db.get( {last_tag, dir, 0} ) );
+  }
+}
+BENCHMARK( CondDB_listing )->Apply( all_backends );
+
+static void CondDB_iov_boundaries( benchmark::State& state ) {
+  auto        db = connect_backend( state );
+  std::size_t i  = 0;
+  for ( auto _ : state ) {
+    benchmark::DoNotOptimize( db.iov_boundaries( last_tag, condition_path( i++ % n_conditions ) ) );
+  }
+}
+BENCHMARK( CondDB_iov_boundaries )->Apply( all_backends );
+
+/// Boundaries of all the conditions, from a new connection (nothing cached).
+static void CondDB_iov_boundaries_all( benchmark::State& state ) {
+  for ( auto _ : state ) {
+    auto db = connect_backend( state );
+    for ( std::size_t i = 0; i < n_conditions; ++i ) {
+      benchmark::DoNotOptimize( db.iov_boundaries( last_tag, condition_path( i ) ) );
+    }
+  }
+  state.SetItemsProcessed( state.iterations() * n_conditions );
+}
+BENCHMARK( CondDB_iov_boundaries_all )->Apply( all_backends )->Unit( benchmark::kMillisecond );
+
+/// Preload of all the conditions, from a new connection.
+static void CondDB_preload( benchmark::State& state ) {
+  for ( auto _ : state ) {
+    auto db = connect_backend( state );
+    db.set_payload_cache_size( 64 * 1024 * 1024 );
+    benchmark::DoNotOptimize( db.preload( last_tag, "Conditions", {} ) );
+  }
+  state.SetItemsProcessed( state.iterations() * n_conditions );
+}
+BENCHMARK( CondDB_preload )->Apply( all_backends )->Unit( benchmark::kMillisecond );
+
+static void CondDB_commit_time( benchmark::State& state ) {
+  auto        db = connect_backend( state );
+  std::size_t i  = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.commit_time( "v" + std::to_string( i++ % n_tags ) ) ); }
+}
+BENCHMARK( CondDB_commit_time )->Apply( all_backends );
+
+namespace {
+  /// libgit2 settings compared in the benchmarks (range(0)): the default ones, caching blobs, small pack windows
+  ConnectOptions git_options( std::int64_t profile ) {
+    static const auto defaults = []() {
+      git_libgit2_init();
+      ConnectOptions options;
+      git_libgit2_opts( GIT_OPT_GET_MWINDOW_SIZE, &options.git_mwindow_size );
+      git_libgit2_opts( GIT_OPT_GET_MWINDOW_MAPPED_LIMIT, &options.git_mwindow_mapped_limit );
+      ssize_t current = 0, max_size = 0;
+      git_libgit2_opts( GIT_OPT_GET_CACHED_MEMORY, &current, &max_size );
+      options.git_cache_max_size = static_cast<std::size_t>( max_size );
+      git_libgit2_shutdown();
+      return options;
+    }();
+    auto options = defaults;
+    // blobs are not cached by default, and 0 would leave the previous value
+    options.git_cache_blob_limit = 1;
+    if ( profile == 1 ) {
+      options.git_cache_blob_limit = 64 * 1024;
+    } else if ( profile == 2 ) {
+      options.git_mwindow_size         = 64 * 1024;
+      options.git_mwindow_mapped_limit = 256 * 1024;
+    }
+    return options;
+  }
+  void git_profiles( benchmark::internal::Benchmark* b ) { b->ArgName( "options" )->DenseRange( 0, 2 ); }
+} // namespace
+
+/// Lookups from a new connection (empty libgit2 caches).
+static void CondDB_get_Git_options_cold( benchmark::State& state ) {
+  const auto  options = git_options( state.range( 0 ) );
+  const auto& keys    = random_keys();
+  for ( auto _ : state ) {
+    auto db = connect( backends[0], options );
+    for ( std::size_t i = 0; i < 100; ++i ) benchmark::DoNotOptimize( db.get( keys[i] ) );
+  }
+  state.SetItemsProcessed( state.iterations() * 100 );
+}
+BENCHMARK( CondDB_get_Git_options_cold )->Apply( git_profiles );
+
+/// Lookups from a connection already used for the same keys.
+static void CondDB_get_Git_options_warm( benchmark::State& state ) {
+  auto        db   = connect( backends[0], git_options( state.range( 0 ) ) );
+  const auto& keys = random_keys();
+  for ( const auto& key : keys ) db.get( key );
+  std::size_t i = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( keys[i++ % keys.size()] ) ); }
+}
+BENCHMARK( CondDB_get_Git_options_warm )->Apply( git_profiles );
+
+/// Lookups on the file: backend, without and with a metadata cache (range(0) is the time to live in ms).
+static void CondDB_get_File_metadata_ttl( benchmark::State& state ) {
+  ConnectOptions options;
+  options.file_metadata_ttl = std::chrono::milliseconds{state.range( 0 )};
+  auto        db   = connect( backends[1], options );
+  const auto& keys = random_keys();
+  std::size_t i    = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( keys[i++ % keys.size()] ) ); }
+}
+BENCHMARK( CondDB_get_File_metadata_ttl )->ArgName( "ttl" )->Arg( 0 )->Arg( 60000 );
@@ -0,0 +1,150 @@
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include "GitCondDB.h"
+
+#include "DBImpl.h"
+
+#include <benchmark/benchmark.h>
+
+#include <optional>
+
+using namespace GitCondDB::v2;
+
+namespace {
+  /// repository generated by tests/prepare_bench_data.py
+  const char* deep_repo = "bench_data/deep/repo.git";
+
+  /// path of the condition at a given depth (see tests/prepare_bench_data.py)
+  std::string deep_path( std::int64_t depth ) {
+    std::string path;
+    for ( std::int64_t i = 1; i < depth; ++i ) path += "level" + std::to_string( i ) + '/';
+    return path + "Cond";
+  }
+} // namespace
+
+/// Reference implementation: resolve the whole "<tag>:<path>" spec at each lookup.
+static void Git_revparse( benchmark::State& state ) {
+  git_libgit2_init();
+  git_repository* repo = nullptr;
+  if ( git_repository_open( &repo, deep_repo ) ) {
+    state.SkipWithError( "cannot open repository" );
+  } else {
+    const auto object_id = "v0:" + deep_path( state.range( 0 ) ) + "/v0";
+    for ( auto _ : state ) {
+      git_object* obj = nullptr;
+      if ( git_revparse_single( &obj, repo, object_id.c_str() ) ) {
+        state.SkipWithError( "cannot resolve object" );
+        break;
+      }
+      auto blob = reinterpret_cast<const git_blob*>( obj );
+      benchmark::DoNotOptimize( std::string{reinterpret_cast<const char*>( git_blob_rawcontent( blob ) ),
+                                            static_cast<std::size_t>( git_blob_rawsize( blob ) )} );
+      git_object_free( obj );
+    }
+  }
+  git_repository_free( repo );
+  git_libgit2_shutdown();
+}
+BENCHMARK( Git_revparse )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+static void GitImpl_get( benchmark::State& state ) {
+  details::GitImpl db{deep_repo};
+  const auto       object_id = "v0:" + deep_path( state.range( 0 ) ) + "/v0";
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( object_id.c_str() ) ); }
+}
+BENCHMARK( GitImpl_get )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+static void GitImpl_exists( benchmark::State& state ) {
+  details::GitImpl db{deep_repo};
+  const auto       object_id = "v0:" + deep_path( state.range( 0 ) ) + "/IOVs";
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.exists( object_id.c_str() ) ); }
+}
+BENCHMARK( GitImpl_exists )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+static void CondDB_get_Git( benchmark::State& state ) {
+  auto              db = connect( deep_repo );
+  const CondDB::Key key{"v0", deep_path( state.range( 0 ) ), 50};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( key ) ); }
+}
+BENCHMARK( CondDB_get_Git )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+static void CondDB_get_Git_cached( benchmark::State& state ) {
+  auto db = connect( deep_repo );
+  db.set_payload_cache_size( 1024 * 1024 );
+  const CondDB::Key key{"v0", deep_path( state.range( 0 ) ), 50};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get( key ) ); }
+}
+BENCHMARK( CondDB_get_Git_cached )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+static void CondDB_get_payload_Git( benchmark::State& state ) {
+  auto              db = connect( deep_repo );
+  const CondDB::Key key{"v0", deep_path( state.range( 0 ) ), 50};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get_payload( key ) ); }
+}
+BENCHMARK( CondDB_get_payload_Git )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Arg( 16 );
+
+namespace {
+  /// a run boundary refresh: 300 keys spread over the conditions of the deep repository
+  std::vector<CondDB::Key> refresh_keys() {
+    const std::int64_t       depths[] = {1, 4, 8, 16};
+    std::vector<CondDB::Key> keys;
+    for ( unsigned int i = 0; i < 300; ++i ) keys.push_back( {"v0", deep_path( depths[i % 4] ), ( i * 7 ) % 200} );
+    return keys;
+  }
+} // namespace
+
+static void CondDB_get_loop_Git( benchmark::State& state ) {
+  auto       db   = connect( deep_repo );
+  const auto keys = refresh_keys();
+  for ( auto _ : state ) {
+    for ( const auto& key : keys ) benchmark::DoNotOptimize( db.get_payload( key ) );
+  }
+}
+BENCHMARK( CondDB_get_loop_Git );
+
+static void CondDB_get_many_Git( benchmark::State& state ) {
+  auto       db   = connect( deep_repo );
+  const auto keys = refresh_keys();
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get_many( keys ) ); }
+}
+BENCHMARK( CondDB_get_many_Git );
+
+/// Throughput of concurrent lookups, using one repository handle (range(0) == 0) or one per thread.
+static void CondDB_get_Git_threads( benchmark::State& state ) {
+  static std::optional<CondDB> db;
+  if ( state.thread_index() == 0 ) {
+    ConnectOptions options;
+    options.repository_handles = state.range( 0 ) ? state.threads() : 1;
+    db.emplace( connect( deep_repo, options ) );
+  }
+  const CondDB::Key key{"v0", deep_path( 8 ), 50};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db->get_payload( key ) ); }
+  if ( state.thread_index() == 0 ) db.reset();
+}
+BENCHMARK( CondDB_get_Git_threads )->ArgName( "per_thread" )->Arg( 0 )->Arg( 1 )->ThreadRange( 1, 8 )->UseRealTime();
+
+/// Event loop: time points increasing by one unit per iteration.
+static void CondDB_events_get_Git( benchmark::State& state ) {
+  auto                 db = connect( deep_repo );
+  const std::string    path{deep_path( 8 )};
+  CondDB::time_point_t t = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get_payload( {"v0", path, t++ % 200} ) ); }
+}
+BENCHMARK( CondDB_events_get_Git );
+
+static void CondDB_events_cursor_Git( benchmark::State& state ) {
+  auto                 db     = connect( deep_repo );
+  auto                 cursor = db.cursor( "v0", deep_path( 8 ) );
+  CondDB::time_point_t t      = 0;
+  for ( auto _ : state ) { benchmark::DoNotOptimize( cursor.at( t++ % 200 ) ); }
+}
+BENCHMARK( CondDB_events_cursor_Git );
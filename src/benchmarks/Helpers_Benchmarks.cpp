@@ -0,0 +1,98 @@
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include "iov_helpers.h"
+#include "path_helpers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <regex>
+#include <string>
+
+using namespace GitCondDB::v2;
+
+namespace {
+  const char* paths[] = {"Conditions/Velo/Alignment/Global.xml", "Conditions/Velo/Alignment/group/../v3",
+                         "/Conditions/Velo/Alignment/group/../v3", "/Conditions/./Velo/a/b/c/../../../Alignment/v3"};
+}
+
+/// Reference implementation: the original regex based normalization.
+static void Normalize_regex( benchmark::State& state ) {
+  static const std::regex ignored_re{"(/[^/]+/\\.\\./)|(/\\./)"};
+  const std::string       input{paths[state.range( 0 )]};
+  for ( auto _ : state ) {
+    std::string path = input, old_path;
+    while ( old_path.length() != path.length() ) {
+      old_path.swap( path );
+      path = std::regex_replace( old_path, ignored_re, "/" );
+    }
+    benchmark::DoNotOptimize( path );
+  }
+}
+BENCHMARK( Normalize_regex )->DenseRange( 0, 3 );
+
+static void Normalize( benchmark::State& state ) {
+  const std::string input{paths[state.range( 0 )]};
+  std::string       path;
+  for ( auto _ : state ) {
+    path = input;
+    GitCondDB::Helpers::normalize_path( path );
+    benchmark::DoNotOptimize( path );
+  }
+}
+BENCHMARK( Normalize )->DenseRange( 0, 3 );
+
+namespace {
+  /// IOVs file with one entry per minute, cycling over a few payloads.
+  std::string per_minute_IOVs( std::size_t minutes ) {
+    std::string data;
+    for ( std::size_t i = 0; i < minutes; ++i ) {
+      data += std::to_string( i * 60000000000 ) + " payload" + std::to_string( i % 10 ) + '\n';
+    }
+    return data;
+  }
+
+  /// a day and a year of IOVs, from text or binary data
+  void IOVs_args( benchmark::internal::Benchmark* b ) {
+    b->ArgNames( {"minutes", "binary"} );
+    for ( int minutes : {1440, 525600} ) {
+      for ( int binary : {0, 1} ) b->Args( {minutes, binary} );
+    }
+  }
+} // namespace
+
+/// Time to get an index from the content of an IOVs file.
+static void IOVs_index( benchmark::State& state ) {
+  const auto text = per_minute_IOVs( state.range( 0 ) );
+  const auto data = CondDB::Payload{state.range( 1 ) ? GitCondDB::Helpers::to_binary_IOVs( text ) : text};
+  for ( auto _ : state ) {
+    benchmark::DoNotOptimize( GitCondDB::Helpers::is_binary_IOVs( data )
+                                  ? GitCondDB::Helpers::binary_IOVs_index( data, false )
+                                  : GitCondDB::Helpers::parse_IOVs_index( data, false ) );
+  }
+  state.SetBytesProcessed( state.iterations() * data.size() );
+}
+BENCHMARK( IOVs_index )->Apply( IOVs_args );
+
+/// Lookup of random time points in an IOVs index.
+static void IOVs_find( benchmark::State& state ) {
+  const auto text  = per_minute_IOVs( state.range( 0 ) );
+  const auto index = state.range( 1 )
+                         ? GitCondDB::Helpers::binary_IOVs_index(
+                               CondDB::Payload{GitCondDB::Helpers::to_binary_IOVs( text )}, false )
+                         : GitCondDB::Helpers::parse_IOVs_index( text, false );
+  CondDB::time_point_t t = 0;
+  for ( auto _ : state ) {
+    t = ( t * 6364136223846793005 + 1442695040888963407 ) % ( state.range( 0 ) * 60000000000 );
+    benchmark::DoNotOptimize( index.find( t ) );
+  }
+}
+BENCHMARK( IOVs_find )->Apply( IOVs_args );
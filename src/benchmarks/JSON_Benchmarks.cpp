@@ -0,0 +1,67 @@
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include "DBImpl.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace GitCondDB::v2;
+
+namespace {
+  /// JSON document with range(0) directories of 10 conditions each
+  std::string make_document( std::int64_t n_dirs ) {
+    nlohmann::json doc;
+    for ( std::int64_t i = 0; i < n_dirs; ++i ) {
+      auto& dir = doc["Conditions"]["dir" + std::to_string( i )];
+      for ( int j = 0; j < 10; ++j ) {
+        auto& cond   = dir["Cond" + std::to_string( j )];
+        cond["IOVs"] = "0 v0\n100 v1\n";
+        cond["v0"]   = "data 0";
+        cond["v1"]   = "data 1";
+      }
+    }
+    return doc.dump();
+  }
+  const char* object_id = "HEAD:Conditions/dir0/Cond5/v1";
+} // namespace
+
+/// Reference implementation: copy the node out of the document.
+static void JSON_value( benchmark::State& state ) {
+  const auto                         doc = nlohmann::json::parse( make_document( state.range( 0 ) ) );
+  const nlohmann::json::json_pointer path{"/Conditions/dir0/Cond5/v1"};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( doc.value( path, nlohmann::json{} ) ); }
+}
+BENCHMARK( JSON_value )->Arg( 10 )->Arg( 1000 );
+
+static void JSON_value_root( benchmark::State& state ) {
+  const auto                         doc = nlohmann::json::parse( make_document( state.range( 0 ) ) );
+  const nlohmann::json::json_pointer path{""};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( doc.value( path, nlohmann::json{} ) ); }
+}
+BENCHMARK( JSON_value_root )->Arg( 10 )->Arg( 1000 );
+
+static void JSONImpl_exists( benchmark::State& state ) {
+  details::JSONImpl db{make_document( state.range( 0 ) ), nullptr, state.range( 1 ) != 0};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.exists( object_id ) ); }
+}
+BENCHMARK( JSONImpl_exists )->ArgNames( {"dirs", "index"} )->ArgsProduct( {{10, 1000}, {0, 1}} );
+
+static void JSONImpl_exists_root( benchmark::State& state ) {
+  details::JSONImpl db{make_document( state.range( 0 ) ), nullptr, state.range( 1 ) != 0};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.exists( "HEAD:" ) ); }
+}
+BENCHMARK( JSONImpl_exists_root )->ArgNames( {"dirs", "index"} )->ArgsProduct( {{10, 1000}, {0, 1}} );
+
+static void JSONImpl_get( benchmark::State& state ) {
+  details::JSONImpl db{make_document( state.range( 0 ) ), nullptr, state.range( 1 ) != 0};
+  for ( auto _ : state ) { benchmark::DoNotOptimize( db.get_payload( object_id ) ); }
+}
+BENCHMARK( JSONImpl_get )->ArgNames( {"dirs", "index"} )->ArgsProduct( {{10, 1000}, {0, 1}} );
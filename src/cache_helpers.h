@@ -0,0 +1,201 @@
+#ifndef CACHE_HELPERS_H
+#define CACHE_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <GitCondDB.h>
+
+#include "common.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace GitCondDB {
+  namespace Helpers {
+    /// Thread safe LRU cache with a budget in bytes.
+    ///
+    /// Entries are distributed over independent shards (each with its own lock and LRU list), so that
+    /// concurrent accesses to different entries do not contend on a single lock. The shards share the
+    /// budget: any entry up to the whole budget can be cached, and eviction takes the least recently used
+    /// entries of the shards in turn (so the order is only approximately LRU across shards).
+    /// A budget of 0 bytes disables the cache.
+    template <class VALUE>
+    class lru_cache {
+    public:
+      using value_type = VALUE;
+
+      lru_cache( std::size_t max_bytes = 0, std::size_t n_shards = 16 ) : m_shards( n_shards ? n_shards : 1 ) {
+        set_max_bytes( max_bytes );
+      }
+
+      bool        enabled() const { return m_max_bytes.load( std::memory_order_relaxed ); }
+      std::size_t max_bytes() const { return m_max_bytes.load( std::memory_order_relaxed ); }
+
+      /// Change the budget of the cache, evicting entries if needed.
+      void set_max_bytes( std::size_t max_bytes ) {
+        m_max_bytes.store( max_bytes, std::memory_order_relaxed );
+        evict();
+      }
+
+      /// Look for an entry, marking it as most recently used.
+      std::optional<VALUE> find( std::string_view key ) {
+        if ( UNLIKELY( !enabled() ) ) return std::nullopt;
+        auto&                       shard = shard_for( key );
+        std::lock_guard<std::mutex> guard( shard.mutex );
+        auto                        it = shard.index.find( key );
+        if ( it == shard.index.end() ) return std::nullopt;
+        shard.entries.splice( shard.entries.begin(), shard.entries, it->second );
+        m_hits.fetch_add( 1, std::memory_order_relaxed );
+        return it->second->value;
+      }
+
+      /// Add an entry to the cache (counted as a miss), evicting the least recently used ones if needed.
+      ///
+      /// Entries larger than the whole budget are not cached.
+      void insert( std::string key, VALUE value, std::size_t size ) {
+        m_misses.fetch_add( 1, std::memory_order_relaxed );
+        if ( UNLIKELY( !enabled() || size > max_bytes() ) ) return;
+        {
+          auto&                       shard = shard_for( key );
+          std::lock_guard<std::mutex> guard( shard.mutex );
+          if ( auto it = shard.index.find( key ); it != shard.index.end() ) {
+            // someone else was faster than us
+            shard.entries.splice( shard.entries.begin(), shard.entries, it->second );
+            return;
+          }
+          shard.entries.push_front( {std::move( key ), std::move( value ), size} );
+          shard.index.emplace( shard.entries.front().key, shard.entries.begin() );
+          m_bytes.fetch_add( size, std::memory_order_relaxed );
+        }
+        evict();
+      }
+
+      /// Remove an entry, if present.
+      void erase( std::string_view key ) {
+        auto&                       shard = shard_for( key );
+        std::lock_guard<std::mutex> guard( shard.mutex );
+        auto                        it = shard.index.find( key );
+        if ( it == shard.index.end() ) return;
+        const auto entry = it->second;
+        m_bytes.fetch_sub( entry->size, std::memory_order_relaxed );
+        shard.index.erase( it );
+        shard.entries.erase( entry );
+      }
+
+      /// Remove the entries whose key satisfies the predicate.
+      template <typename PREDICATE>
+      void erase_if( PREDICATE&& predicate ) {
+        for ( auto& shard : m_shards ) {
+          std::lock_guard<std::mutex> guard( shard.mutex );
+          for ( auto entry = begin( shard.entries ); entry != end( shard.entries ); ) {
+            if ( predicate( std::string_view{entry->key} ) ) {
+              m_bytes.fetch_sub( entry->size, std::memory_order_relaxed );
+              shard.index.erase( entry->key );
+              entry = shard.entries.erase( entry );
+            } else {
+              ++entry;
+            }
+          }
+        }
+      }
+
+      /// Remove all entries (statistics are not reset).
+      void clear() {
+        for ( auto& shard : m_shards ) {
+          std::lock_guard<std::mutex> guard( shard.mutex );
+          for ( const auto& entry : shard.entries ) m_bytes.fetch_sub( entry.size, std::memory_order_relaxed );
+          shard.index.clear();
+          shard.entries.clear();
+        }
+      }
+
+      void reset_stats() {
+        m_hits.store( 0, std::memory_order_relaxed );
+        m_misses.store( 0, std::memory_order_relaxed );
+        m_evictions.store( 0, std::memory_order_relaxed );
+      }
+
+      CondDB::CacheStats stats() const {
+        CondDB::CacheStats out;
+        out.hits      = m_hits.load( std::memory_order_relaxed );
+        out.misses    = m_misses.load( std::memory_order_relaxed );
+        out.evictions = m_evictions.load( std::memory_order_relaxed );
+        out.max_bytes = max_bytes();
+        out.bytes     = m_bytes.load( std::memory_order_relaxed );
+        for ( auto& shard : m_shards ) {
+          std::lock_guard<std::mutex> guard( shard.mutex );
+          out.entries += shard.entries.size();
+        }
+        return out;
+      }
+
+    private:
+      struct entry {
+        std::string key;
+        VALUE       value;
+        std::size_t size;
+      };
+      struct shard_t {
+        std::list<entry>                                                          entries; // most recent first
+        std::unordered_map<std::string_view, typename std::list<entry>::iterator> index;
+        mutable std::mutex                                                        mutex;
+      };
+
+      shard_t& shard_for( std::string_view key ) {
+        return m_shards[std::hash<std::string_view>{}( key ) % m_shards.size()];
+      }
+
+      bool over_budget() const { return m_bytes.load( std::memory_order_relaxed ) > max_bytes(); }
+
+      /// Drop the least recently used entry of each shard in turn until the cache fits in its budget.
+      ///
+      /// The most recent entry of a shard (e.g. the one just inserted) is dropped only if there is nothing
+      /// else left. Only one shard lock is held at a time.
+      void evict() {
+        for ( const std::size_t keep : {1, 0} ) {
+          bool evicted = true;
+          while ( evicted && over_budget() ) {
+            evicted = false;
+            for ( std::size_t i = 0; i < m_shards.size() && over_budget(); ++i ) {
+              auto&                       shard = m_shards[m_next_victim++ % m_shards.size()];
+              std::lock_guard<std::mutex> guard( shard.mutex );
+              if ( shard.entries.size() <= keep ) continue;
+              auto& last = shard.entries.back();
+              m_bytes.fetch_sub( last.size, std::memory_order_relaxed );
+              shard.index.erase( last.key );
+              shard.entries.pop_back();
+              m_evictions.fetch_add( 1, std::memory_order_relaxed );
+              evicted = true;
+            }
+          }
+        }
+      }
+
+      std::vector<shard_t>     m_shards;
+      std::atomic<std::size_t> m_max_bytes{0};
+      std::atomic<std::size_t> m_bytes{0};
+      std::atomic<std::size_t> m_next_victim{0};
+
+      std::atomic<std::size_t> m_hits{0};
+      std::atomic<std::size_t> m_misses{0};
+      std::atomic<std::size_t> m_evictions{0};
+    };
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // CACHE_HELPERS_H
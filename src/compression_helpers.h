@@ -0,0 +1,84 @@
+#ifndef COMPRESSION_HELPERS_H
+#define COMPRESSION_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+namespace GitCondDB {
+  namespace Helpers {
+    /// Tell if the data starts with the header of a gzip stream (magic bytes and deflate method).
+    inline bool is_gzip( std::string_view data ) {
+      return data.size() >= 18 && data[0] == '\x1f' && data[1] == '\x8b' && data[2] == '\x08';
+    }
+
+    /// Decompress gzip data (possibly made of several concatenated gzip streams).
+    inline std::string gunzip( std::string_view data ) {
+      z_stream stream{};
+      if ( inflateInit2( &stream, 16 + MAX_WBITS ) != Z_OK ) throw std::runtime_error{"cannot initialize zlib"};
+      struct end_guard {
+        z_stream& stream;
+        ~end_guard() { inflateEnd( &stream ); }
+      } guard{stream};
+
+      // the gzip trailer contains the size of the uncompressed data (modulo 2^32) of the last stream,
+      // which cannot be more than ~1000 times the compressed size
+      const auto*         trailer = reinterpret_cast<const unsigned char*>( data.data() + data.size() - 4 );
+      const std::uint32_t size_hint =
+          trailer[0] | ( trailer[1] << 8 ) | ( trailer[2] << 16 ) | ( std::uint32_t( trailer[3] ) << 24 );
+
+      std::string out( std::clamp<std::size_t>( size_hint, data.size(), 1032 * data.size() ), '\0' );
+      stream.next_in  = reinterpret_cast<Bytef*>( const_cast<char*>( data.data() ) );
+      stream.avail_in = static_cast<uInt>( data.size() );
+      std::size_t done = 0;
+      while ( true ) {
+        if ( done == out.size() ) out.resize( 2 * out.size() );
+        stream.next_out  = reinterpret_cast<Bytef*>( out.data() + done );
+        stream.avail_out = static_cast<uInt>( out.size() - done );
+        const int status = inflate( &stream, Z_NO_FLUSH );
+        done             = out.size() - stream.avail_out;
+        if ( status == Z_STREAM_END ) {
+          if ( !stream.avail_in ) break;
+          inflateReset( &stream ); // another gzip stream follows
+        } else if ( status != Z_OK && !( status == Z_BUF_ERROR && !stream.avail_out ) ) {
+          throw std::runtime_error{std::string{"invalid gzip data: "} + ( stream.msg ? stream.msg : "truncated" )};
+        }
+      }
+      out.resize( done );
+      return out;
+    }
+
+    /// Compress data in the gzip format (e.g. to prepare payloads in tests).
+    inline std::string gzip( std::string_view data, int level = Z_DEFAULT_COMPRESSION ) {
+      z_stream stream{};
+      if ( deflateInit2( &stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+        throw std::runtime_error{"cannot initialize zlib"};
+      std::string out( deflateBound( &stream, static_cast<uLong>( data.size() ) ), '\0' );
+      stream.next_in   = reinterpret_cast<Bytef*>( const_cast<char*>( data.data() ) );
+      stream.avail_in  = static_cast<uInt>( data.size() );
+      stream.next_out  = reinterpret_cast<Bytef*>( out.data() );
+      stream.avail_out = static_cast<uInt>( out.size() );
+      const int status = deflate( &stream, Z_FINISH );
+      deflateEnd( &stream );
+      if ( status != Z_STREAM_END ) throw std::runtime_error{"gzip compression failed"};
+      out.resize( out.size() - stream.avail_out );
+      return out;
+    }
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // COMPRESSION_HELPERS_H
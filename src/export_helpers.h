@@ -0,0 +1,176 @@
+#ifndef EXPORT_HELPERS_H
+#define EXPORT_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <GitCondDB.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace GitCondDB {
+  namespace Helpers {
+    namespace fs = std::filesystem;
+
+    /// Name of the file, in an exported directory, with the content id and path of each exported file.
+    constexpr const char* export_manifest_name = ".gitconddb_manifest";
+
+    /// Collect the paths (relative to `source`) of the files and conditions under `dir` (relative to
+    /// `source` too), reading each listing once.
+    inline void collect_export_files( const CondDB& db, const std::string& tag, const std::string& source,
+                                      const std::string& dir, CondDB::time_point_t time,
+                                      std::vector<std::string>& files ) {
+      using json         = nlohmann::json;
+      const auto path    = dir.empty() ? source : source + '/' + dir;
+      const auto listing = json::parse( std::get<0>( db.get( {tag, path, time} ) ) );
+      const auto prefix  = dir.empty() ? dir : dir + '/';
+      for ( const auto& name : listing["files"] ) files.push_back( prefix + name.get<std::string>() );
+      for ( const auto& name : listing["dirs"] )
+        collect_export_files( db, tag, source, prefix + name.get<std::string>(), time, files );
+    }
+
+    /// Read the manifest of an export, i.e. "<content id>\t<path>" lines (the id is empty if the backend
+    /// has none), returning the ids by path.
+    inline std::unordered_map<std::string, std::string> read_export_manifest( const fs::path& path ) {
+      std::unordered_map<std::string, std::string> manifest;
+      std::ifstream                                in( path );
+      std::string                                  line;
+      while ( std::getline( in, line ) ) {
+        const auto tab = line.find( '\t' );
+        if ( tab != std::string::npos ) manifest.emplace( line.substr( tab + 1 ), line.substr( 0, tab ) );
+      }
+      return manifest;
+    }
+
+    /// Check that a path read from a manifest refers to a file inside `dest`.
+    inline bool is_inside( const fs::path& dest, const std::string& file ) {
+      const fs::path relative{file};
+      if ( file.empty() || relative.is_absolute() || relative.has_root_name() ) return false;
+      for ( const auto& part : relative ) {
+        if ( part == ".." || part == "." ) return false;
+      }
+      const auto root     = fs::weakly_canonical( dest );
+      const auto target   = fs::weakly_canonical( dest / relative );
+      const auto mismatch = std::mismatch( root.begin(), root.end(), target.begin(), target.end() );
+      return mismatch.first == root.end() && mismatch.second != target.end();
+    }
+
+    /// Write a file through a temporary one, so that an interrupted export does not leave truncated files.
+    inline void write_export_file( const fs::path& path, std::string_view data ) {
+      auto tmp = path;
+      tmp += ".tmp";
+      {
+        std::ofstream out( tmp, std::ios::binary );
+        out.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+        if ( !out.flush() ) throw std::runtime_error( "cannot write " + tmp.string() );
+      }
+      fs::rename( tmp, path );
+    }
+
+    /// Check if a file exists with the given content.
+    inline bool same_content( const fs::path& path, std::string_view data ) {
+      std::error_code ec;
+      if ( fs::file_size( path, ec ) != data.size() || ec ) return false;
+      std::ifstream in( path, std::ios::binary );
+      return std::equal( data.begin(), data.end(), std::istreambuf_iterator<char>{in} );
+    }
+
+    /// Summary of an export (see export_directory).
+    struct export_result {
+      std::size_t              files     = 0;
+      std::size_t              written   = 0;
+      std::size_t              unchanged = 0;
+      std::size_t              removed   = 0;
+      std::vector<std::string> errors;
+    };
+
+    /// Export the files and conditions under `source` (at the given time) to `dest`, using `threads` threads.
+    ///
+    /// A manifest in `dest` records the content id of each exported file, so that a later export does
+    /// not rewrite the files whose id did not change (or, without ids, whose content did not change), and
+    /// removes the files of the previous export that are not in the source anymore.
+    inline export_result export_directory( const CondDB& db, const std::string& tag, const std::string& source,
+                                           CondDB::time_point_t time, const fs::path& dest, std::size_t threads ) {
+      std::vector<std::string> files;
+      collect_export_files( db, tag, source, "", time, files );
+
+      fs::create_directories( dest );
+      const auto old_manifest = read_export_manifest( dest / export_manifest_name );
+
+      export_result            result;
+      std::vector<std::string> ids( files.size() );
+      std::atomic<std::size_t> next{0}, written{0}, failed{0};
+      std::mutex               errors_mutex;
+
+      auto worker = [&]() {
+        for ( std::size_t i = next++; i < files.size(); i = next++ ) {
+          const auto target = dest / files[i];
+          try {
+            auto [payload, iov, id] = db.get_payload_with_id( {tag, source + '/' + files[i], time} );
+            const auto old          = old_manifest.find( files[i] );
+            ids[i]                  = std::move( id );
+            if ( !ids[i].empty() && old != old_manifest.end() && old->second == ids[i] && fs::exists( target ) )
+              continue;
+            if ( same_content( target, payload.view() ) ) continue;
+            fs::create_directories( target.parent_path() );
+            write_export_file( target, payload.view() );
+            ++written;
+          } catch ( const std::exception& err ) {
+            std::lock_guard<std::mutex> lock( errors_mutex );
+            result.errors.push_back( files[i] + ": " + err.what() );
+            ids[i].clear(); // so that it is exported again next time
+            ++failed;
+          }
+        }
+      };
+      std::vector<std::thread> pool;
+      for ( std::size_t i = 1; i < threads; ++i ) pool.emplace_back( worker );
+      worker();
+      for ( auto& thread : pool ) thread.join();
+
+      // remove the files of the previous export that are gone
+      std::unordered_map<std::string, std::string> manifest;
+      for ( std::size_t i = 0; i < files.size(); ++i ) manifest.emplace( files[i], ids[i] );
+      for ( const auto& [file, id] : old_manifest ) {
+        if ( manifest.count( file ) ) continue;
+        if ( !is_inside( dest, file ) ) {
+          result.errors.push_back( "invalid path in manifest: " + file );
+          continue;
+        }
+        if ( fs::remove( dest / file ) ) ++result.removed;
+      }
+
+      std::string content;
+      for ( std::size_t i = 0; i < files.size(); ++i ) {
+        content.append( ids[i] ).append( 1, '\t' ).append( files[i] ).append( 1, '\n' );
+      }
+      write_export_file( dest / export_manifest_name, content );
+
+      result.files     = files.size();
+      result.written   = written;
+      result.unchanged = files.size() - written - failed;
+      return result;
+    }
+  } // namespace Helpers
+} // namespace GitCondDB
+#endif // EXPORT_HELPERS_H
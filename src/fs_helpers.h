@@ -0,0 +1,318 @@
+#ifndef FS_HELPERS_H
+#define FS_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <GitCondDB.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace GitCondDB {
+  namespace Helpers {
+    /// Type and size of a filesystem entry, as reported by a single call to `stat`.
+    struct file_info {
+      enum class kind_t { missing, directory, regular, other };
+      kind_t      kind = kind_t::missing;
+      std::size_t size = 0;
+
+      bool exists() const { return kind != kind_t::missing; }
+    };
+
+    inline file_info stat_path( const char* path ) {
+      struct stat st;
+      if ( ::stat( path, &st ) ) return {};
+      return {S_ISDIR( st.st_mode ) ? file_info::kind_t::directory
+                                    : S_ISREG( st.st_mode ) ? file_info::kind_t::regular : file_info::kind_t::other,
+              static_cast<std::size_t>( st.st_size )};
+    }
+
+    [[noreturn]] inline void throw_errno( std::string_view what, const char* path ) {
+      throw std::runtime_error{std::string{what} + " " + path + ": " + std::strerror( errno )};
+    }
+
+    /// File descriptor closed on destruction.
+    class file_descriptor {
+    public:
+      file_descriptor( const char* path ) : m_fd{::open( path, O_RDONLY | O_CLOEXEC )} {
+        if ( m_fd < 0 ) throw_errno( "cannot open", path );
+      }
+      file_descriptor( const file_descriptor& ) = delete;
+      file_descriptor& operator=( const file_descriptor& ) = delete;
+      ~file_descriptor() { ::close( m_fd ); }
+
+      int get() const { return m_fd; }
+
+    private:
+      int m_fd;
+    };
+
+    /// Read-only memory mapping of a file, unmapped on destruction.
+    class file_mapping {
+    public:
+      file_mapping( int fd, std::size_t size, const char* path ) : m_size{size} {
+        m_addr = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( m_addr == MAP_FAILED ) throw_errno( "cannot map", path );
+      }
+      file_mapping( const file_mapping& ) = delete;
+      file_mapping& operator=( const file_mapping& ) = delete;
+      ~file_mapping() { ::munmap( m_addr, m_size ); }
+
+      std::string_view view() const { return {static_cast<const char*>( m_addr ), m_size}; }
+
+    private:
+      void*       m_addr;
+      std::size_t m_size;
+    };
+
+    /// Read the content of the regular file `path`.
+    ///
+    /// The size is taken from the open file (not from the metadata cache, which may be outdated).
+    /// Files of at least `mmap_threshold` bytes (if not 0) are mapped in memory and the returned Payload
+    /// keeps the mapping alive, so that large payloads are never copied. Note that truncating a file
+    /// while a Payload mapping it is still in use makes the access to the missing part fail (SIGBUS).
+    inline CondDB::Payload read_file( const char* path, std::size_t mmap_threshold ) {
+      file_descriptor fd{path};
+      struct stat     st;
+      if ( ::fstat( fd.get(), &st ) ) throw_errno( "cannot stat", path );
+      const auto size = static_cast<std::size_t>( st.st_size );
+      if ( mmap_threshold && size >= mmap_threshold ) {
+        auto       mapping = std::make_shared<const file_mapping>( fd.get(), size, path );
+        const auto data    = mapping->view();
+        return {std::move( mapping ), data};
+      }
+      std::string data( size, 0 );
+      std::size_t done = 0;
+      while ( done < size ) {
+        const auto n = ::pread( fd.get(), data.data() + done, size - done, static_cast<off_t>( done ) );
+        if ( n < 0 ) {
+          if ( errno == EINTR ) continue;
+          throw_errno( "cannot read", path );
+        }
+        if ( n == 0 ) break; // the file was truncated since we got its size
+        done += static_cast<std::size_t>( n );
+      }
+      data.resize( done );
+      return CondDB::Payload{std::move( data )};
+    }
+
+    /// List the entries of the directory `path`, split in subdirectories and other entries.
+    ///
+    /// The type reported by `readdir` is used when available, so that there is no `stat` per entry
+    /// (except for symbolic links, which are followed).
+    inline void list_directory( const char* path, std::vector<std::string>& dirs, std::vector<std::string>& files ) {
+      DIR* dir = ::opendir( path );
+      if ( !dir ) throw_errno( "cannot open directory", path );
+      std::unique_ptr<DIR, int ( * )( DIR* )> guard{dir, ::closedir};
+      errno = 0;
+      while ( const auto* entry = ::readdir( dir ) ) {
+        const char* name = entry->d_name;
+        if ( name[0] == '.' && ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) ) ) continue;
+        bool is_dir = entry->d_type == DT_DIR;
+        if ( entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK ) {
+          struct stat st;
+          is_dir = !::fstatat( ::dirfd( dir ), name, &st, 0 ) && S_ISDIR( st.st_mode );
+        }
+        ( is_dir ? dirs : files ).emplace_back( name );
+      }
+    }
+
+    /// Thread safe cache of file_info by path, with entries valid for a fixed time after the `stat`.
+    ///
+    /// A time to live of 0 disables the cache (every call to get does a `stat`).
+    class metadata_cache {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      explicit metadata_cache( clock::duration ttl = clock::duration::zero() ) : m_ttl{ttl} {}
+
+      bool enabled() const { return m_ttl > clock::duration::zero(); }
+
+      file_info get( const std::string& path ) const {
+        if ( !enabled() ) return stat_path( path.c_str() );
+        const auto now = clock::now();
+        {
+          std::shared_lock lock{m_mutex};
+          if ( auto it = m_entries.find( path ); it != m_entries.end() && it->second.expires > now ) {
+            return it->second.info;
+          }
+        }
+        const auto       info = stat_path( path.c_str() );
+        std::unique_lock lock{m_mutex};
+        m_entries[path] = {info, now + m_ttl};
+        return info;
+      }
+
+      void clear() {
+        std::unique_lock lock{m_mutex};
+        m_entries.clear();
+      }
+
+    private:
+      struct entry {
+        file_info         info;
+        clock::time_point expires;
+      };
+
+      clock::duration                                m_ttl;
+      mutable std::shared_mutex                      m_mutex;
+      mutable std::unordered_map<std::string, entry> m_entries;
+    };
+
+    /// Metadata and content ids of the files and directories read from a tree, kept valid by watching
+    /// (with inotify) the directories containing them.
+    ///
+    /// The id of an entry is its path followed by a generation number, and it changes when the entry, or
+    /// anything below it, is modified. The ids of the invalidated entries are passed to a callback, so
+    /// that what was cached for them can be dropped. Only local changes are notified (not the changes made
+    /// by other hosts on network filesystems).
+    class watched_tree {
+    public:
+      using callback_t = std::function<void( const std::vector<std::string>& )>;
+
+      struct entry {
+        file_info   info;
+        std::string id; ///< empty if the path does not exist
+      };
+
+      watched_tree( callback_t on_invalidate )
+          : m_fd{::inotify_init1( IN_NONBLOCK | IN_CLOEXEC )}, m_on_invalidate{std::move( on_invalidate )} {
+        if ( m_fd < 0 ) throw std::runtime_error{std::string{"cannot initialize inotify: "} + std::strerror( errno )};
+      }
+      watched_tree( const watched_tree& ) = delete;
+      watched_tree& operator=( const watched_tree& ) = delete;
+      ~watched_tree() { ::close( m_fd ); }
+
+      /// Metadata and id of a path, watching its parent directory to be notified of changes.
+      entry get( const std::string& path ) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        process_events();
+        if ( auto it = m_entries.find( path ); it != m_entries.end() ) return it->second;
+
+        // stat under the lock, so that no event can be processed before the entry is recorded
+        entry      out{stat_path( path.c_str() ), {}};
+        const bool watched = add_watch( parent_of( path ) );
+        if ( out.info.exists() ) {
+          // if changes cannot be notified we use an id that cannot match anything cached
+          out.id = path + '@' + std::to_string( m_generation ) +
+                   ( watched ? std::string{} : 'u' + std::to_string( ++m_unwatched ) );
+        }
+        if ( watched ) m_entries.emplace( path, out );
+        return out;
+      }
+
+      /// Watch a directory, to be notified of changes to its entries (to be called before listing it).
+      bool watch( const std::string& dir ) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return add_watch( dir );
+      }
+
+    private:
+      static std::string parent_of( const std::string& path ) {
+        const auto pos = path.rfind( '/' );
+        return pos == path.npos ? "." : pos == 0 ? "/" : path.substr( 0, pos );
+      }
+
+      bool add_watch( const std::string& dir ) {
+        if ( m_watched.count( dir ) ) return true;
+        const int wd = ::inotify_add_watch( m_fd, dir.c_str(),
+                                            IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM |
+                                                IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+        if ( wd < 0 ) return false;
+        m_dirs.emplace( wd, dir );
+        m_watched.emplace( dir, wd );
+        return true;
+      }
+
+      /// Read the pending notifications and invalidate the entries they refer to (lock must be held).
+      void process_events() {
+        alignas( inotify_event ) char buffer[4096];
+        std::vector<std::string>      changed;
+        bool                          overflow = false;
+        ssize_t                       n;
+        while ( ( n = ::read( m_fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+          for ( const char* p = buffer; p < buffer + n; ) {
+            const auto* event = reinterpret_cast<const inotify_event*>( p );
+            p += sizeof( inotify_event ) + event->len;
+            if ( event->mask & IN_Q_OVERFLOW ) overflow = true;
+            const auto dir = m_dirs.find( event->wd );
+            if ( dir == m_dirs.end() ) continue;
+            changed.push_back( event->len ? dir->second + '/' + event->name : dir->second );
+            if ( event->mask & IN_IGNORED ) { // the directory is gone
+              m_watched.erase( dir->second );
+              m_dirs.erase( dir );
+            }
+          }
+        }
+        if ( changed.empty() && !overflow ) return;
+
+        std::vector<std::string> ids;
+        if ( overflow ) { // we do not know what changed
+          for ( auto& [path, entry] : m_entries ) {
+            if ( !entry.id.empty() ) ids.push_back( std::move( entry.id ) );
+          }
+          m_entries.clear();
+        } else {
+          for ( const auto& path : changed ) invalidate( path, ids );
+        }
+        ++m_generation;
+        if ( !ids.empty() ) m_on_invalidate( ids );
+      }
+
+      /// Drop the entries of a path, of what is below it and of its parents (lock must be held).
+      void invalidate( const std::string& path, std::vector<std::string>& ids ) {
+        const auto drop = [this, &ids]( auto it ) {
+          if ( !it->second.id.empty() ) ids.push_back( std::move( it->second.id ) );
+          return m_entries.erase( it );
+        };
+        if ( auto it = m_entries.find( path ); it != m_entries.end() ) drop( it );
+        const auto prefix = path + '/';
+        for ( auto it = m_entries.lower_bound( prefix );
+              it != m_entries.end() && it->first.compare( 0, prefix.size(), prefix ) == 0; )
+          it = drop( it );
+        for ( auto pos = path.rfind( '/' ); pos != path.npos && pos > 0; pos = path.rfind( '/', pos - 1 ) ) {
+          if ( auto it = m_entries.find( path.substr( 0, pos ) ); it != m_entries.end() ) drop( it );
+        }
+      }
+
+      int        m_fd;
+      callback_t m_on_invalidate;
+
+      std::mutex                           m_mutex;
+      std::map<std::string, entry>         m_entries; // ordered, to find what is below a directory
+      std::unordered_map<int, std::string> m_dirs;    // watched directories by watch descriptor
+      std::unordered_map<std::string, int> m_watched;
+      // the counters start from the creation time, so that ids are not reused by another instance
+      // (e.g. in a later run)
+      std::size_t m_generation =
+          static_cast<std::size_t>( std::chrono::system_clock::now().time_since_epoch().count() );
+      std::size_t m_unwatched = 0;
+    };
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // FS_HELPERS_H
@@ -12,11 +12,16 @@
 \*****************************************************************************/
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <git2.h>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace GitCondDB {
   namespace Helpers {
@@ -27,47 +32,124 @@ namespace GitCondDB {
     struct git_repository_deleter {
       void operator()( git_repository* ptr ) { git_repository_free( ptr ); }
     };
+    struct git_tree_entry_deleter {
+      void operator()( git_tree_entry* ptr ) { git_tree_entry_free( ptr ); }
+    };
+
+    using git_object_ptr     = std::unique_ptr<git_object, git_object_deleter>;
+    using git_tree_entry_ptr = std::unique_ptr<git_tree_entry, git_tree_entry_deleter>;
+
+    /// Helper to keep libgit2 initialized as long as an instance is alive.
+    struct git_library {
+      git_library() { git_libgit2_init(); }
+      ~git_library() { git_libgit2_shutdown(); }
+    };
+
+    using git_repository_storage_t = std::unique_ptr<git_repository, git_repository_deleter>;
 
-    using git_object_ptr = std::unique_ptr<git_object, git_object_deleter>;
+    /// Fixed size pool of objects, each of them used by only one thread at a time.
+    ///
+    /// Each thread preferably uses the slot associated with it (threads are distributed round robin
+    /// over the slots), so that, if there are at least as many slots as threads, acquiring a slot is
+    /// just an uncontended atomic exchange. If the preferred slot is busy, the other slots are tried,
+    /// and if all of them are busy the thread sleeps until one is released.
+    template <class T>
+    class exclusive_pool {
+      struct alignas( 64 ) slot_t {
+        std::atomic<bool> busy{false};
+        T                 value;
+      };
 
-    /// Helper class to allow on-demand connection to the git repository.
-    class git_repository_ptr {
     public:
-      using storage_t = std::unique_ptr<git_repository, git_repository_deleter>;
-      using factory_t = std::function<storage_t()>;
-      using pointer   = storage_t::pointer;
-      using reference = std::add_lvalue_reference<storage_t::element_type>::type;
-
-      git_repository_ptr( factory_t factory ) : m_factory( std::move( factory ) ) {}
-
-      pointer get() const {
-        {
-          std::lock_guard<std::mutex> guard( m_ptr_mutex );
-          if ( !m_ptr ) {
-            m_ptr = m_factory();
-            if ( !m_ptr ) throw std::runtime_error( "unable create object" );
-          }
+      /// Exclusive access to an object of the pool, released on destruction.
+      class lease {
+      public:
+        lease( lease&& other )
+            : m_pool{std::exchange( other.m_pool, nullptr )}, m_slot{std::exchange( other.m_slot, nullptr )} {}
+        lease( const lease& ) = delete;
+        ~lease() {
+          if ( m_slot ) m_pool->release( *m_slot );
         }
-        return m_ptr.get();
-      }
 
-      reference operator*() const { return *get(); }
+        T& operator*() const { return m_slot->value; }
+        T* operator->() const { return &m_slot->value; }
+
+      private:
+        friend class exclusive_pool;
+        lease( const exclusive_pool& pool, slot_t& slot ) : m_pool{&pool}, m_slot{&slot} {}
+
+        const exclusive_pool* m_pool;
+        slot_t*               m_slot;
+      };
 
-      pointer operator->() const { return get(); }
+      exclusive_pool( std::size_t size ) : m_slots( size ? size : 1 ) {}
 
-      explicit operator bool() const { return get(); }
+      std::size_t size() const { return m_slots.size(); }
 
-      void reset() {
-        std::lock_guard<std::mutex> guard( m_ptr_mutex );
-        m_ptr.reset();
+      /// Get exclusive access to one of the objects, waiting if all of them are in use.
+      lease acquire() const {
+        const std::size_t n     = m_slots.size();
+        const std::size_t first = thread_index() % n;
+        const auto        any   = [this, n, first]() -> std::optional<lease> {
+          for ( std::size_t k = 0, i = first; k < n; ++k, i = ( i + 1 == n ) ? 0 : i + 1 ) {
+            if ( auto l = try_acquire( i ) ) return l;
+          }
+          return std::nullopt;
+        };
+        if ( auto l = any() ) return std::move( *l );
+        return wait_for( any );
       }
 
-      bool is_set() const { return bool{m_ptr}; }
+      /// Get exclusive access to a specific object, waiting if it is in use.
+      lease acquire( std::size_t i ) const {
+        if ( auto l = try_acquire( i ) ) return std::move( *l );
+        return wait_for( [this, i]() { return try_acquire( i ); } );
+      }
 
     private:
-      factory_t          m_factory;
-      mutable storage_t  m_ptr;
-      mutable std::mutex m_ptr_mutex;
+      std::optional<lease> try_acquire( std::size_t i ) const {
+        auto& slot = m_slots[i];
+        if ( !slot.busy.load() && !slot.busy.exchange( true ) ) return lease{*this, slot};
+        return std::nullopt;
+      }
+
+      /// Sleep until `attempt` gets a lease.
+      template <class F>
+      lease wait_for( F attempt ) const {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        // the releasing threads check the number of waiters after freeing the slot, so either they see
+        // this thread waiting or this thread sees the slot free
+        m_waiters.fetch_add( 1 );
+        while ( true ) {
+          if ( auto l = attempt() ) {
+            m_waiters.fetch_sub( 1 );
+            return std::move( *l );
+          }
+          m_released.wait( lock );
+        }
+      }
+
+      void release( slot_t& slot ) const {
+        slot.busy.store( false );
+        if ( m_waiters.load() ) {
+          // taking the lock ensures the waiters are either sleeping or still to check the slots
+          { std::lock_guard<std::mutex> lock{m_mutex}; }
+          // all of them, because some may be waiting for a specific slot
+          m_released.notify_all();
+        }
+      }
+
+      /// Small integer identifying the current thread.
+      static std::size_t thread_index() {
+        static std::atomic<std::size_t> counter{0};
+        thread_local const std::size_t  index = counter.fetch_add( 1, std::memory_order_relaxed );
+        return index;
+      }
+
+      mutable std::vector<slot_t>      m_slots;
+      mutable std::mutex               m_mutex;
+      mutable std::condition_variable  m_released;
+      mutable std::atomic<std::size_t> m_waiters{0};
     };
   } // namespace Helpers
 } // namespace GitCondDB
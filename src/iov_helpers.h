@@ -15,62 +15,330 @@
 
 #include "common.h"
 
-#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <zlib.h>
 
 namespace GitCondDB {
   namespace Helpers {
-    std::tuple<std::string, CondDB::IOV> get_key_iov( const std::string& data, const CondDB::time_point_t t,
-                                                      const CondDB::IOV& boundaries  = {},
-                                                      const bool         reduce_iovs = true ) {
-      std::tuple<std::string, CondDB::IOV> out;
-      auto&                                key   = std::get<0>( out );
-      auto&                                since = std::get<1>( out ).since;
-      auto&                                until = std::get<1>( out ).until;
-
-      if ( UNLIKELY( t < boundaries.since || t >= boundaries.until ) ) {
-        since = until = 0;
-      } else {
-        CondDB::time_point_t current = 0;
-        std::string          line;
-
-        std::istringstream stream{data};
-        std::string        tmp_key;
-
-        while ( std::getline( stream, line ) ) {
-          std::istringstream is{line};
-          is >> current >> tmp_key;
-          if ( !reduce_iovs || tmp_key != key ) { // if we do not need to reduce IOVs, ignore identical keys
-            if ( current > t ) {
-              until = current; // what we read is the "until" for the previous key
-              break;           // and we need to use the previous key
+    /// Name of the file making a directory a condition.
+    constexpr std::string_view IOVs_file_name{"IOVs"};
+
+    /// Layout of the binary IOVs files ("IOVs.bin", optional companions of the text "IOVs" files), with the
+    /// same entries in fixed-width little-endian records, so that they can be searched without parsing:
+    ///
+    ///     offset          content
+    ///     0               magic bytes "GCDBIOV\2" (version 2 of the format)
+    ///     8               uint32 number of entries (n), uint32 number of keys (k)
+    ///     16              uint32 flags (see repeated_keys), uint32 reserved (0)
+    ///     24              uint64 size and uint32 CRC-32 of the text IOVs file, uint32 reserved (0)
+    ///     40              uint64 since[n] (sorted)
+    ///     40 + 8n         uint32 key_id[n]
+    ///     40 + 12n        uint32 key_end[k] (key i is [key_end[i-1], key_end[i]) in the key data)
+    ///     40 + 12n + 4k   key data
+    ///
+    /// The size and checksum of the text file it was generated from tell if a binary file is outdated
+    /// (e.g. if the text file was modified by a tool not aware of the binary version).
+    namespace binary_IOVs {
+      constexpr std::string_view magic{"GCDBIOV\x02", 8};
+      constexpr std::size_t      text_identity_pos = 24;
+      constexpr std::size_t      header_size       = 40;
+      /// Flag set if consecutive entries may have the same key (i.e. if the IOVs can be reduced).
+      constexpr std::uint32_t repeated_keys = 1;
+
+      template <typename T>
+      T load( const char* data ) {
+        T value;
+        std::memcpy( &value, data, sizeof( T ) );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        if constexpr ( sizeof( T ) == 8 ) value = __builtin_bswap64( value );
+        if constexpr ( sizeof( T ) == 4 ) value = __builtin_bswap32( value );
+#endif
+        return value;
+      }
+
+      template <typename T>
+      void store( std::string& out, T value ) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        if constexpr ( sizeof( T ) == 8 ) value = __builtin_bswap64( value );
+        if constexpr ( sizeof( T ) == 4 ) value = __builtin_bswap32( value );
+#endif
+        char buffer[sizeof( T )];
+        std::memcpy( buffer, &value, sizeof( T ) );
+        out.append( buffer, sizeof( T ) );
+      }
+
+      /// CRC-32 of the text IOVs file, as stored in the header.
+      inline std::uint32_t checksum( std::string_view text ) {
+        return static_cast<std::uint32_t>(
+            crc32( 0, reinterpret_cast<const Bytef*>( text.data() ), static_cast<uInt>( text.size() ) ) );
+      }
+    } // namespace binary_IOVs
+
+    inline bool is_binary_IOVs( std::string_view data ) {
+      return data.substr( 0, binary_IOVs::magic.size() ) == binary_IOVs::magic;
+    }
+
+    /// Check if binary IOVs data was generated from the given content of the text IOVs file.
+    inline bool binary_IOVs_match( std::string_view binary, std::string_view text ) {
+      using namespace binary_IOVs;
+      if ( binary.size() < header_size || !is_binary_IOVs( binary ) ) return false;
+      return load<std::uint64_t>( binary.data() + text_identity_pos ) == text.size() &&
+             load<std::uint32_t>( binary.data() + text_identity_pos + 8 ) == checksum( text );
+    }
+
+    /// Parsed content of an IOVs file.
+    ///
+    /// The entries (since, index in the keys table) are sorted by "since", so the lookup of the key
+    /// valid at a given time point is a binary search.
+    ///
+    /// For binary IOVs files (see binary_IOVs_index) the entries and keys tables are not filled, and the
+    /// search is done directly on the records of the file.
+    struct IOVIndex {
+      using time_point_t = CondDB::time_point_t;
+
+      std::vector<std::pair<time_point_t, std::uint32_t>> entries;
+      std::vector<std::string>                            keys;
+
+      /// Content of the binary IOVs file, if the index refers to one.
+      CondDB::Payload binary;
+      std::size_t     binary_size = 0; ///< number of entries in the binary file
+      std::size_t     binary_keys = 0; ///< number of keys in the binary file
+
+      std::size_t size() const { return binary.empty() ? entries.size() : binary_size; }
+      bool        empty() const { return size() == 0; }
+
+      time_point_t since( std::size_t i ) const {
+        if ( binary.empty() ) return entries[i].first;
+        return binary_IOVs::load<std::uint64_t>( binary.data() + binary_IOVs::header_size + 8 * i );
+      }
+      std::string_view key( std::size_t i ) const {
+        if ( binary.empty() ) return keys[entries[i].second];
+        return binary_key(
+            binary_IOVs::load<std::uint32_t>( binary.data() + binary_IOVs::header_size + 8 * binary_size + 4 * i ) );
+      }
+      CondDB::IOV iov( std::size_t i ) const {
+        return {since( i ), ( i + 1 < size() ) ? since( i + 1 ) : CondDB::IOV::max()};
+      }
+
+      /// Key with the given id in the keys table of a binary IOVs file.
+      std::string_view binary_key( std::uint32_t id ) const {
+        const char* key_ends = binary.data() + binary_IOVs::header_size + 12 * binary_size;
+        const auto  begin    = id ? binary_IOVs::load<std::uint32_t>( key_ends + 4 * ( id - 1 ) ) : 0;
+        const auto  end      = binary_IOVs::load<std::uint32_t>( key_ends + 4 * id );
+        return {key_ends + 4 * binary_keys + begin, end - begin};
+      }
+
+      /// Return the key valid at time point t and its IOV, restricted to the boundaries.
+      ///
+      /// If t is outside the boundaries, the returned IOV is not valid. If t is before the first
+      /// entry, the returned key is empty.
+      std::tuple<std::string_view, CondDB::IOV> find( const time_point_t t, const CondDB::IOV& boundaries = {} ) const {
+        std::size_t position = 0;
+        return find( t, boundaries, position );
+      }
+
+      /// Same as find( t, boundaries ), using and updating `position` as a hint for next_position.
+      std::tuple<std::string_view, CondDB::IOV> find( const time_point_t t, const CondDB::IOV& boundaries,
+                                                      std::size_t& position ) const {
+        if ( UNLIKELY( t < boundaries.since || t >= boundaries.until ) ) return {std::string_view{}, {0, 0}};
+
+        position = next_position( t, position );
+
+        std::tuple<std::string_view, CondDB::IOV> out;
+        auto&                                     validity = std::get<1>( out );
+
+        validity.since = 0;
+        if ( position != size() ) validity.until = since( position );
+        if ( position ) {
+          std::get<0>( out ) = key( position - 1 );
+          validity.since     = since( position - 1 );
+        }
+        validity.cut( boundaries );
+        return out;
+      }
+
+      /// Position of the first entry starting after t (i.e. one past the entry valid at t).
+      ///
+      /// If `hint` is the result for an earlier time point, the search proceeds forward from it with
+      /// increasing steps, which is faster than a plain binary search when time points increase slowly.
+      std::size_t next_position( const time_point_t t, const std::size_t hint = 0 ) const {
+        std::size_t first = 0;
+        std::size_t last  = size();
+        if ( hint && hint <= last && since( hint - 1 ) <= t ) {
+          first = hint;
+          for ( std::size_t step = 1; first < last && since( first ) <= t; step *= 2 ) {
+            if ( first + step >= last || since( first + step ) > t ) {
+              last = std::min( first + step, last );
+              ++first;
+              break;
             }
-            key   = std::move( tmp_key );
-            since = current; // the time we read is the "since" for the read key
+            first += step + 1;
           }
         }
-        std::get<1>( out ).cut( boundaries );
+        // upper bound in [first, last)
+        while ( first < last ) {
+          const auto middle = first + ( last - first ) / 2;
+          if ( since( middle ) <= t ) {
+            first = middle + 1;
+          } else {
+            last = middle;
+          }
+        }
+        return first;
+      }
+    };
+
+    /// IOVs of a condition with its nested IOVs tables flattened, mapping time points directly to the
+    /// paths of the payloads (relative to the condition).
+    ///
+    /// The segments are contiguous, from since[0] to the end of time. Segments without a payload (e.g.
+    /// before the first entry of a nested table) have the key id no_payload.
+    struct FlatIOVs {
+      using time_point_t = CondDB::time_point_t;
+
+      static constexpr std::uint32_t no_payload = std::numeric_limits<std::uint32_t>::max();
+
+      std::vector<time_point_t>  since;
+      std::vector<std::uint32_t> key_ids;
+      std::vector<std::string>   keys;
+
+      /// Return the key valid at time point t (nullptr if there is none) and its IOV.
+      std::tuple<const std::string*, CondDB::IOV> find( const time_point_t t ) const {
+        const std::size_t position = std::upper_bound( begin( since ), end( since ), t ) - begin( since );
+        if ( !position || key_ids[position - 1] == no_payload ) return {nullptr, {0, 0}};
+        return {&keys[key_ids[position - 1]],
+                {since[position - 1], position < since.size() ? since[position] : CondDB::IOV::max()}};
+      }
+    };
+
+    /// Parse the content of an IOVs file (lines in the format "<since> <key>", sorted by "since").
+    ///
+    /// If reduce_iovs is true, entries with the same key as the previous one are merged into it.
+    inline IOVIndex parse_IOVs_index( std::string_view data, const bool reduce_iovs = true ) {
+      IOVIndex                                            out;
+      std::unordered_map<std::string_view, std::uint32_t> key_ids;
+
+      auto is_space = []( char c ) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; };
+
+      std::string_view last_key;
+      while ( !data.empty() ) {
+        auto line = data.substr( 0, data.find( '\n' ) );
+        data.remove_prefix( std::min( line.size() + 1, data.size() ) );
+
+        while ( !line.empty() && is_space( line.front() ) ) line.remove_prefix( 1 );
+        CondDB::time_point_t since = 0;
+        const auto [ptr, ec]       = std::from_chars( line.data(), line.data() + line.size(), since );
+        if ( UNLIKELY( ec != std::errc{} ) ) continue; // ignore invalid lines
+        line.remove_prefix( ptr - line.data() );
+
+        while ( !line.empty() && is_space( line.front() ) ) line.remove_prefix( 1 );
+        std::size_t key_len = 0;
+        while ( key_len < line.size() && !is_space( line[key_len] ) ) ++key_len;
+        const auto key = line.substr( 0, key_len );
+        if ( UNLIKELY( key.empty() ) ) continue; // ignore invalid lines
+
+        if ( reduce_iovs && key == last_key ) continue;
+        last_key = key;
+
+        auto [id, added] = key_ids.emplace( key, static_cast<std::uint32_t>( out.keys.size() ) );
+        if ( added ) out.keys.emplace_back( key );
+        out.entries.emplace_back( since, id->second );
       }
+
       return out;
     }
 
-    std::vector<std::pair<CondDB::IOV, std::string>> parse_IOVs_keys( const std::string& data ) {
-      std::vector<std::pair<CondDB::IOV, std::string>> out;
-      std::string                                      line;
+    /// Make an index referring to the content of a binary IOVs file (see binary_IOVs), without copying it.
+    ///
+    /// The tables are checked to be consistent, so that the lookups cannot read outside of the data.
+    /// If reduce_iovs is true and the file has consecutive entries with the same key, the reduced
+    /// entries are copied to the entries and keys tables of the index.
+    inline IOVIndex binary_IOVs_index( CondDB::Payload data, const bool reduce_iovs = true ) {
+      using namespace binary_IOVs;
+      const auto invalid = []() { return std::runtime_error{"invalid binary IOVs data"}; };
+      if ( data.size() < header_size || !is_binary_IOVs( data ) ) throw invalid();
+
+      IOVIndex out;
+      out.binary_size         = load<std::uint32_t>( data.data() + 8 );
+      out.binary_keys         = load<std::uint32_t>( data.data() + 12 );
+      const auto flags        = load<std::uint32_t>( data.data() + 16 );
+      const auto key_data_pos = header_size + 12 * out.binary_size + 4 * out.binary_keys;
+      if ( key_data_pos > data.size() ) throw invalid();
+      const char* key_ends = data.data() + header_size + 12 * out.binary_size;
+      for ( std::size_t i = 0, previous = 0; i < out.binary_keys; ++i ) {
+        const std::size_t end = load<std::uint32_t>( key_ends + 4 * i );
+        if ( end < previous || key_data_pos + end > data.size() ) throw invalid();
+        previous = end;
+      }
+      const char* key_ids = data.data() + header_size + 8 * out.binary_size;
+      for ( std::size_t i = 0; i < out.binary_size; ++i ) {
+        if ( load<std::uint32_t>( key_ids + 4 * i ) >= out.binary_keys ) throw invalid();
+      }
+      out.binary = std::move( data );
 
-      CondDB::time_point_t bound;
-      std::string          key;
+      if ( !reduce_iovs || !( flags & repeated_keys ) ) return out;
 
-      std::istringstream stream{data};
+      IOVIndex reduced;
+      reduced.keys.reserve( out.binary_keys );
+      for ( std::uint32_t id = 0; id < out.binary_keys; ++id ) reduced.keys.emplace_back( out.binary_key( id ) );
+      for ( std::size_t i = 0; i < out.binary_size; ++i ) {
+        if ( i && out.key( i ) == out.key( i - 1 ) ) continue;
+        reduced.entries.emplace_back( out.since( i ), load<std::uint32_t>( key_ids + 4 * i ) );
+      }
+      return reduced;
+    }
 
-      while ( std::getline( stream, line ) ) {
-        std::istringstream is{line};
-        is >> bound >> key;
-        if ( LIKELY( !out.empty() ) ) { out.back().first.until = bound; }
-        out.emplace_back( CondDB::IOV{bound, CondDB::IOV::max()}, std::move( key ) );
+    /// Convert the content of a text IOVs file to the binary format (see binary_IOVs).
+    inline std::string to_binary_IOVs( std::string_view data ) {
+      using namespace binary_IOVs;
+      const auto index = parse_IOVs_index( data, false );
+
+      std::uint32_t flags = 0;
+      for ( std::size_t i = 1; i < index.size(); ++i ) {
+        if ( index.entries[i].second == index.entries[i - 1].second ) flags |= repeated_keys;
       }
 
+      std::string out{magic};
+      store<std::uint32_t>( out, static_cast<std::uint32_t>( index.size() ) );
+      store<std::uint32_t>( out, static_cast<std::uint32_t>( index.keys.size() ) );
+      store<std::uint32_t>( out, flags );
+      store<std::uint32_t>( out, 0 );
+      store<std::uint64_t>( out, data.size() );
+      store<std::uint32_t>( out, checksum( data ) );
+      store<std::uint32_t>( out, 0 );
+      for ( const auto& entry : index.entries ) store<std::uint64_t>( out, entry.first );
+      for ( const auto& entry : index.entries ) store<std::uint32_t>( out, entry.second );
+      std::uint32_t end = 0;
+      for ( const auto& key : index.keys ) store<std::uint32_t>( out, end += static_cast<std::uint32_t>( key.size() ) );
+      for ( const auto& key : index.keys ) out += key;
+      return out;
+    }
+
+    inline std::tuple<std::string, CondDB::IOV> get_key_iov( const std::string& data, const CondDB::time_point_t t,
+                                                             const CondDB::IOV& boundaries  = {},
+                                                             const bool         reduce_iovs = true ) {
+      const auto [key, iov] = parse_IOVs_index( data, reduce_iovs ).find( t, boundaries );
+      return {std::string{key}, iov};
+    }
+
+    inline std::vector<std::pair<CondDB::IOV, std::string>> parse_IOVs_keys( const std::string& data ) {
+      const auto index = parse_IOVs_index( data, false );
+
+      std::vector<std::pair<CondDB::IOV, std::string>> out;
+      out.reserve( index.size() );
+      for ( std::size_t i = 0; i < index.size(); ++i ) out.emplace_back( index.iov( i ), index.key( i ) );
+
       return out;
     }
   } // namespace Helpers
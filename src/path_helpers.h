@@ -0,0 +1,83 @@
+#ifndef PATH_HELPERS_H
+#define PATH_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include "common.h"
+
+#include <string>
+
+namespace GitCondDB {
+  namespace Helpers {
+    namespace details {
+      /// Replace, from left to right, the non overlapping occurrences of "/<entry>/../" and "/./" with "/"
+      /// in the range [begin, end) of the string, compacting it in place.
+      ///
+      /// Returns the new end of the range and sets `first` to the position of the first replacement
+      /// (unchanged if there was no replacement).
+      inline std::size_t normalize_step( char* data, std::size_t begin, std::size_t end, std::size_t& first ) {
+        std::size_t out = begin;
+        std::size_t in  = begin;
+        while ( in < end ) {
+          if ( data[in] != '/' ) {
+            data[out++] = data[in++];
+            continue;
+          }
+          // find the end of the entry following the '/'
+          std::size_t next = in + 1;
+          while ( next < end && data[next] != '/' ) ++next;
+          std::size_t match_end = 0;
+          if ( next > in + 1 && next + 3 < end && data[next + 1] == '.' && data[next + 2] == '.' &&
+               data[next + 3] == '/' ) {
+            match_end = next + 4; // "/<entry>/../"
+          } else if ( next == in + 2 && next < end && data[in + 1] == '.' ) {
+            match_end = next + 1; // "/./"
+          }
+          if ( match_end ) {
+            if ( first > out ) first = out;
+            data[out++] = '/';
+            in          = match_end;
+          } else {
+            while ( in < next ) data[out++] = data[in++];
+          }
+        }
+        return out;
+      }
+    } // namespace details
+
+    /// Remove in place the "/<entry>/../" and "/./" parts of the path starting at position `pos` of the
+    /// string (the part before is left untouched).
+    ///
+    /// The result is the same as replacing repeatedly the matches of the regular expression
+    /// `(/[^/]+/\.\./)|(/\./)` with "/" until the string does not change anymore (which was the original
+    /// implementation), including its quirks: leading "./" or "../", trailing "/." or "/.." and entries
+    /// not enclosed in '/' are left untouched, and ".." can cancel a preceding "..".
+    inline void normalize_path( std::string& path, std::size_t pos = 0 ) {
+      if ( LIKELY( path.find( "/.", pos ) == std::string::npos ) ) return;
+
+      char*       data  = path.data();
+      std::size_t end   = path.size();
+      std::size_t begin = pos;
+      while ( true ) {
+        std::size_t first = std::string::npos;
+        end               = details::normalize_step( data, begin, end, first );
+        if ( first == std::string::npos ) break;
+        // a new match can only start with the entry preceding the first replacement
+        begin = first;
+        while ( begin > pos && data[begin - 1] != '/' ) --begin;
+        if ( begin > pos ) --begin;
+      }
+      path.resize( end );
+    }
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // PATH_HELPERS_H
@@ -0,0 +1,95 @@
+#ifndef STATS_HELPERS_H
+#define STATS_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <GitCondDB.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace GitCondDB {
+  namespace Helpers {
+    /// Histogram of durations with buckets of powers of 2 nanoseconds, safe to fill from several threads.
+    class latency_histogram {
+    public:
+      static constexpr std::size_t n_buckets = 40;
+
+      void record( std::chrono::nanoseconds duration ) {
+        const std::uint64_t ns     = duration.count() > 0 ? static_cast<std::uint64_t>( duration.count() ) : 0;
+        std::size_t         bucket = 0;
+        for ( auto value = ns >> 1; value && bucket < n_buckets - 1; value >>= 1 ) ++bucket;
+        m_counts[bucket].fetch_add( 1, std::memory_order_relaxed );
+        m_total.fetch_add( ns, std::memory_order_relaxed );
+      }
+
+      CondDB::LatencyHistogram snapshot() const {
+        CondDB::LatencyHistogram out;
+        out.counts.reserve( n_buckets );
+        for ( const auto& count : m_counts ) {
+          out.counts.push_back( count.load( std::memory_order_relaxed ) );
+          out.count += out.counts.back();
+        }
+        out.total = std::chrono::nanoseconds( m_total.load( std::memory_order_relaxed ) );
+        return out;
+      }
+
+      void reset() {
+        for ( auto& count : m_counts ) count.store( 0, std::memory_order_relaxed );
+        m_total.store( 0, std::memory_order_relaxed );
+      }
+
+    private:
+      std::array<std::atomic<std::size_t>, n_buckets> m_counts{};
+      std::atomic<std::uint64_t>                      m_total{0};
+    };
+
+    /// Record in a histogram the time elapsed between construction and destruction.
+    class scoped_timer {
+    public:
+      scoped_timer( latency_histogram& histogram )
+          : m_histogram{histogram}, m_start{std::chrono::steady_clock::now()} {}
+      ~scoped_timer() { m_histogram.record( std::chrono::steady_clock::now() - m_start ); }
+
+    private:
+      latency_histogram&                    m_histogram;
+      std::chrono::steady_clock::time_point m_start;
+    };
+
+    /// Counters kept by a backend (see CondDB::stats).
+    struct backend_stats {
+      std::atomic<std::size_t> lookups{0};
+      std::atomic<std::size_t> objects{0};
+      std::atomic<std::size_t> bytes{0};
+      std::atomic<std::size_t> iov_hits{0};
+      std::atomic<std::size_t> iov_misses{0};
+      std::atomic<std::size_t> listing_hits{0};
+      std::atomic<std::size_t> listing_misses{0};
+
+      latency_histogram lookup_latency;
+      latency_histogram read_latency;
+      latency_histogram iov_parse_latency;
+
+      static void count( std::atomic<std::size_t>& counter, std::size_t n = 1 ) {
+        counter.fetch_add( n, std::memory_order_relaxed );
+      }
+
+      void reset() {
+        for ( auto* counter : {&lookups, &objects, &bytes, &iov_hits, &iov_misses, &listing_hits, &listing_misses} )
+          counter->store( 0, std::memory_order_relaxed );
+        for ( auto* histogram : {&lookup_latency, &read_latency, &iov_parse_latency} ) histogram->reset();
+      }
+    };
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // STATS_HELPERS_H
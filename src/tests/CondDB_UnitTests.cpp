@@ -12,13 +12,18 @@
 #include "GitCondDB.h"
 
 #include "DBImpl.h"
+#include "compression_helpers.h"
 #include "iov_helpers.h"
 
 #include "test_common.h"
 
 #include "gtest/gtest.h"
 
-using namespace GitCondDB::v1;
+#include <fstream>
+#include <optional>
+#include <thread>
+
+using namespace GitCondDB::v2;
 
 namespace {
   /// helper to extract the file name from a full path
@@ -236,6 +241,70 @@ TEST( CondDB, GetIOVs ) {
   }
 }
 
+TEST( CondDB, IOVs ) {
+  using Entries = std::vector<std::tuple<CondDB::IOV, std::string>>;
+  {
+    CondDB db = connect( "test_data/repo" );
+
+    const Entries expected{{{0, 100}, "Cond/v0"},
+                           {{100, 150}, "Cond/v1"},
+                           {{150, 200}, "Cond/v2"},
+                           {{200, CondDB::IOV::max()}, "Cond/v3"}};
+    auto          to_tuples = []( const Entries& entries ) {
+      std::vector<std::tuple<CondDB::time_point_t, CondDB::time_point_t, std::string>> out;
+      for ( const auto& [iov, path] : entries ) out.emplace_back( iov.since, iov.until, path );
+      return out;
+    };
+
+    EXPECT_EQ( to_tuples( db.iovs( "v1", "Cond" ) ), to_tuples( expected ) );
+    // memoized
+    EXPECT_EQ( to_tuples( db.iovs( "v1", "Cond" ) ), to_tuples( expected ) );
+    EXPECT_GT( db.stats().iov_entries_cache.hits, 0 );
+    EXPECT_EQ( to_tuples( db.iovs( "v1", "Cond", {120, 160} ) ),
+               to_tuples( {{{120, 150}, "Cond/v1"}, {{150, 160}, "Cond/v2"}} ) );
+    EXPECT_EQ( to_tuples( db.iovs( "v1", "Cond/group", {0, 200} ) ),
+               to_tuples( {{{50, 150}, "Cond/v1"}, {{150, 200}, "Cond/v2"}} ) );
+
+    for ( const auto& [iov, path] : expected ) {
+      EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", iov.since} ) ), std::get<0>( db.get( {"v1", path, 0} ) ) );
+    }
+
+    EXPECT_TRUE( db.iovs( "v1", "Cond", {10, 10} ).empty() );
+    EXPECT_TRUE( db.iovs( "v1", "NoCond" ).empty() );
+
+    ConnectOptions options;
+    options.repository_handles = 4;
+    EXPECT_EQ( to_tuples( connect( "test_data/repo", options ).iovs( "v1", "Cond" ) ), to_tuples( expected ) );
+
+    // the memoized entries are bounded in memory
+    options.iov_entries_cache_size = 0;
+    CondDB no_memo                 = connect( "test_data/repo", options );
+    EXPECT_EQ( to_tuples( no_memo.iovs( "v1", "Cond" ) ), to_tuples( expected ) );
+    EXPECT_EQ( to_tuples( no_memo.iovs( "v1", "Cond" ) ), to_tuples( expected ) );
+    EXPECT_EQ( no_memo.stats().iov_entries_cache.entries, 0 );
+  }
+  {
+    CondDB db = connect( R"(json:{
+                          "Cond": {
+                            "IOVs": "0 a\n100 levelA\n200 b\n",
+                            "levelA": {
+                              "IOVs": "50 i\n150 ../levelB\n300 k\n"
+                            },
+                            "levelB": {
+                              "IOVs": "150 x\n170 y\n"
+                            }
+                          }
+                          })" );
+
+    std::vector<std::string> expected{"Cond/a", "Cond/levelA/i", "Cond/levelB/x", "Cond/levelB/y", "Cond/b"};
+    for ( int i = 0; i < 2; ++i ) {
+      std::vector<std::string> paths;
+      for ( const auto& entry : db.iovs( "", "Cond" ) ) paths.push_back( std::get<1>( entry ) );
+      EXPECT_EQ( paths, expected );
+    }
+  }
+}
+
 TEST( CondDB, Directory_FS ) {
   CondDB db = connect( "file:test_data/lhcb/repo" );
 
@@ -453,6 +522,629 @@ TEST( CondDB, IOVReduction ) {
   }
 }
 
+TEST( CondDB, PayloadCache ) {
+  CondDB db = connect( "test_data/repo.git" );
+  EXPECT_EQ( db.payload_cache_size(), 0 );
+
+  db.set_payload_cache_size( 1024 * 1024 );
+  EXPECT_EQ( db.payload_cache_size(), 1024 * 1024 );
+
+  for ( int i = 0; i < 2; ++i ) {
+    auto [data, iov] = db.get( {"v1", "Cond", 110} );
+    EXPECT_EQ( data, "data 1" );
+    EXPECT_EQ( iov.since, 100 );
+    EXPECT_EQ( iov.until, 150 );
+  }
+  {
+    auto stats = db.payload_cache_stats();
+    EXPECT_EQ( stats.hits, 1 );
+    EXPECT_EQ( stats.misses, 1 );
+    EXPECT_EQ( stats.entries, 1 );
+    EXPECT_EQ( stats.bytes, 6 );
+  }
+
+  // same content from another tag and path
+  EXPECT_EQ( std::get<0>( db.get( {"v0", "Cond/v1", 0} ) ), "data 1" );
+  EXPECT_EQ( db.payload_cache_stats().hits, 2 );
+  EXPECT_EQ( db.payload_cache_stats().entries, 1 );
+
+  // directories are not cached
+  db.get( {"v1", "", 0} );
+  EXPECT_EQ( db.payload_cache_stats().entries, 1 );
+
+  // the cached payloads refer to the repository, which is closed by disconnect
+  db.disconnect();
+  EXPECT_FALSE( db.connected() );
+  EXPECT_EQ( db.payload_cache_stats().entries, 0 );
+  EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 110} ) ), "data 1" );
+  EXPECT_EQ( db.payload_cache_stats().entries, 1 );
+
+  db.set_payload_cache_size( 0 );
+  EXPECT_EQ( db.payload_cache_stats().entries, 0 );
+  EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 110} ) ), "data 1" );
+  EXPECT_EQ( db.payload_cache_stats().entries, 0 );
+
+  {
+    // payloads bigger than a fraction of the budget are cached too
+    const std::string big( 2 * 1024 * 1024, 'x' );
+    CondDB            json_db = connect( "json:{\"Big\": \"" + big + "\", \"Small\": \"small\"}" );
+    json_db.set_payload_cache_size( 3 * 1024 * 1024 );
+    for ( int i = 0; i < 2; ++i ) EXPECT_EQ( std::get<0>( json_db.get( {"HEAD", "Big", 0} ) ), big );
+    auto stats = json_db.payload_cache_stats();
+    EXPECT_EQ( stats.hits, 1 );
+    EXPECT_EQ( stats.entries, 1 );
+    EXPECT_EQ( stats.bytes, big.size() );
+
+    // room is made for new entries
+    EXPECT_EQ( std::get<0>( json_db.get( {"HEAD", "Small", 0} ) ), "small" );
+    json_db.set_payload_cache_size( 2 * 1024 * 1024 );
+    stats = json_db.payload_cache_stats();
+    EXPECT_EQ( stats.entries, 1 );
+    EXPECT_LE( stats.bytes, 2 * 1024 * 1024 );
+  }
+}
+
+TEST( CondDB, GetPayload ) {
+  std::optional<CondDB::Payload> payload;
+  {
+    CondDB db = connect( "test_data/repo.git" );
+
+    auto [data, iov] = db.get_payload( {"v1", "Cond", 110} );
+    EXPECT_EQ( data.view(), "data 1" );
+    EXPECT_EQ( data.view(), std::get<0>( db.get( {"v1", "Cond", 110} ) ) );
+    EXPECT_EQ( iov.since, 100 );
+    EXPECT_EQ( iov.until, 150 );
+
+    // directories are converted as with get
+    EXPECT_EQ( std::get<0>( db.get_payload( {"v1", "", 0} ) ).view(), std::get<0>( db.get( {"v1", "", 0} ) ) );
+
+    // the payload outlives the connection and the CondDB instance
+    payload = data;
+    db.disconnect();
+    EXPECT_FALSE( db.connected() );
+    EXPECT_EQ( payload->view(), "data 1" );
+  }
+  EXPECT_EQ( payload->view(), "data 1" );
+  EXPECT_EQ( payload->size(), 6 );
+
+  {
+    CondDB db = connect( "file:test_data/repo" );
+    payload   = std::get<0>( db.get_payload( {"v1", "Cond", 110} ) );
+  }
+  EXPECT_EQ( payload->str(), std::get<0>( connect( "file:test_data/repo" ).get( {"v1", "Cond", 110} ) ) );
+
+  {
+    CondDB db = connect( R"(json:{"Cond": {"IOVs": "0 v0\n", "v0": "data 0"}})" );
+    payload   = std::get<0>( db.get_payload( {"HEAD", "Cond", 10} ) );
+  }
+  EXPECT_EQ( payload->view(), "data 0" );
+}
+
+TEST( CondDB, GetMany ) {
+  auto logger = std::make_shared<CapturingLogger>();
+
+  CondDB db = connect( R"(json:
+                       {"Cond": {"IOVs": "0 v0\n100 group\n200 v2\n",
+                                 "v0": "data 0",
+                                 "v1": "data 1",
+                                 "v2": "data 2",
+                                 "group": {"IOVs": "50 ../v1\n150 ../v2\n"}},
+                        "TheDir": {"TheFile.txt": "some data\n"}}
+                       )",
+                       logger );
+
+  const std::vector<CondDB::Key> keys{{"HEAD", "Cond", 210},       {"HEAD", "TheDir/TheFile.txt", 0},
+                                      {"HEAD", "Cond", 0},         {"HEAD", "Cond", 120},
+                                      {"HEAD", "Cond", 160},       {"HEAD", "", 0},
+                                      {"HEAD", "Cond/group", 160}, {"HEAD", "Cond", 120}};
+
+  const auto results = db.get_many( keys );
+  ASSERT_EQ( results.size(), keys.size() );
+
+  const auto count = [&logger]( std::string_view msg ) {
+    return std::count_if( begin( logger->logged_messages ), end( logger->logged_messages ),
+                          [msg]( const auto& entry ) { return std::get<1>( entry ) == msg; } );
+  };
+  // each object is read only once (and the directory of a condition is not needed to look it up)
+  EXPECT_EQ( count( "accessing entry '/Cond'" ), 0 );
+  EXPECT_EQ( count( "accessing entry '/Cond/group'" ), 1 );
+  EXPECT_EQ( count( "accessing entry '/Cond/v1'" ), 1 );
+
+  for ( std::size_t i = 0; i < keys.size(); ++i ) {
+    const auto& [data, iov]             = results[i];
+    const auto [expected, expected_iov] = db.get( keys[i] );
+    EXPECT_EQ( data.view(), expected ) << "key " << i;
+    EXPECT_EQ( iov.since, expected_iov.since ) << "key " << i;
+    EXPECT_EQ( iov.until, expected_iov.until ) << "key " << i;
+  }
+  EXPECT_EQ( std::get<0>( results[3] ).view(), "data 1" );
+  EXPECT_EQ( std::get<1>( results[3] ).since, 100 );
+  EXPECT_EQ( std::get<1>( results[3] ).until, 150 );
+
+  EXPECT_TRUE( db.get_many( {} ).empty() );
+
+  try {
+    db.get_many( {{"HEAD", "Cond", 0}, {"HEAD", "Nothing", 0}} );
+    FAIL() << "exception expected for invalid path";
+  } catch ( std::runtime_error& err ) {
+    EXPECT_EQ( std::string_view{err.what()}, "cannot resolve object HEAD:Nothing" );
+  }
+}
+
+TEST( CondDB, Cursor ) {
+  for ( const char* repository : {"test_data/repo.git", "file:test_data/repo"} ) {
+    CondDB db = connect( repository );
+
+    auto cursor = db.cursor( "v1", "Cond" );
+    // forward, then backward, then with jumps
+    std::vector<CondDB::time_point_t> times;
+    for ( CondDB::time_point_t t = 0; t < 300; t += 7 ) times.push_back( t );
+    for ( CondDB::time_point_t t = 300; t > 11; t -= 11 ) times.push_back( t );
+    for ( CondDB::time_point_t t : {10, 250, 120, 160, 0, 149, 150, 50} ) times.push_back( t );
+
+    for ( const auto t : times ) {
+      const auto [data, iov]              = cursor.at( t );
+      const auto [expected, expected_iov] = db.get_payload( {"v1", "Cond", t} );
+      EXPECT_EQ( data.view(), expected.view() ) << repository << " t=" << t;
+      EXPECT_EQ( iov.since, expected_iov.since ) << repository << " t=" << t;
+      EXPECT_EQ( iov.until, expected_iov.until ) << repository << " t=" << t;
+    }
+  }
+
+  auto logger = std::make_shared<CapturingLogger>();
+
+  CondDB db = connect( R"(json:
+                       {"Cond": {"IOVs": "10 v0\n100 group\n200 v2\n",
+                                 "v0": "data 0",
+                                 "v1": "data 1",
+                                 "v2": "data 2",
+                                 "group": {"IOVs": "50 ../v1\n150 ../v2\n"}},
+                        "TheDir": {"TheFile.txt": "some data\n"}}
+                       )",
+                       logger );
+
+  auto cursor = db.cursor( "HEAD", "Cond" );
+  // before the first IOV (as with get)
+  EXPECT_THROW( cursor.at( 5 ), std::runtime_error );
+  EXPECT_THROW( db.get( {"HEAD", "Cond", 5} ), std::runtime_error );
+  {
+    auto [data, iov] = cursor.at( 110 );
+    EXPECT_EQ( data.view(), "data 1" );
+    EXPECT_EQ( iov.since, 100 );
+    EXPECT_EQ( iov.until, 150 );
+  }
+  // no access to the database while in the same IOV
+  const auto accesses = logger->size();
+  for ( CondDB::time_point_t t = 110; t < 150; ++t ) EXPECT_EQ( std::get<0>( cursor.at( t ) ).view(), "data 1" );
+  EXPECT_EQ( logger->size(), accesses );
+
+  {
+    // moving within the nested table does not reload the outer one
+    auto [data, iov] = cursor.at( 160 );
+    EXPECT_EQ( data.view(), "data 2" );
+    EXPECT_EQ( iov.since, 150 );
+    EXPECT_EQ( iov.until, 200 );
+    EXPECT_FALSE( logger->contains( accesses, "accessing entry '/Cond'" ) );
+  }
+
+  auto file = db.cursor( "HEAD", "TheDir/TheFile.txt" );
+  EXPECT_EQ( std::get<0>( file.at( 0 ) ).view(), "some data\n" );
+  EXPECT_EQ( std::get<0>( file.at( 1000 ) ).view(), "some data\n" );
+}
+
+TEST( CondDB, Prefetch ) {
+  CondDB db = connect( "test_data/repo.git" );
+  EXPECT_FALSE( db.prefetch() );
+  db.set_prefetch( true );
+  EXPECT_TRUE( db.prefetch() );
+
+  // without the payload cache there is nothing to do
+  EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 110} ) ), "data 1" );
+
+  CondDB moved = std::move( db );
+  moved.set_payload_cache_size( 1024 * 1024 );
+  {
+    auto [data, iov] = moved.get( {"v1", "Cond", 110} );
+    EXPECT_EQ( data, "data 1" );
+    EXPECT_EQ( iov.until, 150 );
+  }
+
+  // wait for the payload of the next IOV to appear in the cache
+  for ( int i = 0; i < 500 && moved.payload_cache_stats().entries < 2; ++i ) {
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  }
+  EXPECT_EQ( moved.payload_cache_stats().entries, 2 );
+
+  const auto hits = moved.payload_cache_stats().hits;
+  EXPECT_EQ( std::get<0>( moved.get( {"v1", "Cond", 150} ) ), "data 2" );
+  EXPECT_EQ( moved.payload_cache_stats().hits, hits + 1 );
+
+  moved.set_prefetch( false );
+  EXPECT_FALSE( moved.prefetch() );
+}
+
+TEST( CondDB, Preload ) {
+  for ( std::size_t threads : {1, 2} ) {
+    ConnectOptions options;
+    options.repository_handles = threads;
+    CondDB db                  = connect( "test_data/repo", options );
+    db.set_payload_cache_size( 1024 * 1024 );
+
+    EXPECT_EQ( db.preload( "v1", "", {0, 175}, threads ), 3 ); // v0, v1 and v2
+    EXPECT_EQ( db.payload_cache_stats().entries, 3 );
+    EXPECT_EQ( db.preload( "v1", "Cond", {}, threads ), 4 );
+    EXPECT_EQ( db.payload_cache_stats().entries, 4 );
+    EXPECT_EQ( db.preload( "v1", "TheDir", {}, threads ), 0 );
+    EXPECT_EQ( db.preload( "v1", "NoDir", {}, threads ), 0 );
+
+    // the lookups do not need to read any file (IOVs or payload)
+    const auto bytes = db.stats().bytes;
+    EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 110} ) ), "data 1" );
+    EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 250} ) ), "data 3" );
+    EXPECT_EQ( db.stats().bytes, bytes );
+  }
+}
+
+TEST( CondDB, GetAsync ) {
+  CondDB db = connect( "test_data/repo" );
+
+  auto single = db.get_async( {"v1", "Cond", 110} );
+  auto many   = db.get_many_async( {{"v1", "Cond", 0}, {"v1", "Cond", 160}} );
+  auto error  = db.get_async( {"v1", "NoCond", 0} );
+  {
+    auto [data, iov] = single.get();
+    EXPECT_EQ( data, "data 1" );
+    EXPECT_EQ( iov.since, 100 );
+    EXPECT_EQ( iov.until, 150 );
+  }
+  {
+    const auto results = many.get();
+    ASSERT_EQ( results.size(), 2 );
+    EXPECT_EQ( std::get<0>( results[0] ).str(), "data 0" );
+    EXPECT_EQ( std::get<0>( results[1] ).str(), "data 2" );
+  }
+  EXPECT_THROW( error.get(), std::runtime_error );
+
+  // custom executor
+  std::vector<std::function<void()>> tasks;
+  db.set_executor( [&tasks]( std::function<void()> task ) { tasks.push_back( std::move( task ) ); } );
+  auto deferred = db.get_async( {"v1", "Cond", 250} );
+  ASSERT_EQ( tasks.size(), 1 );
+  EXPECT_EQ( deferred.wait_for( std::chrono::seconds( 0 ) ), std::future_status::timeout );
+  CondDB moved = std::move( db ); // pending tasks do not depend on the instance
+  tasks.front()();
+  EXPECT_EQ( std::get<0>( deferred.get() ), "data 3" );
+
+  moved.set_executor( nullptr );
+  EXPECT_EQ( std::get<0>( moved.get_async( {"v1", "Cond", 250} ).get() ), "data 3" );
+}
+
+TEST( CondDB, Pin ) {
+  // work on a copy of the repository, to move its HEAD
+  const auto repo = make_temp_dir( "test_GitCondDB_pin.git" );
+  fs::copy( "test_data/repo.git", repo, fs::copy_options::recursive );
+
+  CondDB     db   = connect( repo.string() );
+  const auto view = db.pin( "HEAD" );
+  EXPECT_EQ( view.tag(), "HEAD" );
+  EXPECT_EQ( view.id(), db.pin( "v1" ).id() );
+  EXPECT_NE( view.id(), db.pin( "v0" ).id() );
+  EXPECT_EQ( view.id().size(), 40 );
+  EXPECT_THROW( db.pin( "no-tag" ), std::runtime_error );
+
+  const auto v0_data = std::get<0>( db.get( {"v0", "Cond", 200} ) );
+  const auto v1_data = std::get<0>( db.get( {"v1", "Cond", 200} ) );
+  ASSERT_NE( v0_data, v1_data );
+
+  // move HEAD (a loose ref takes precedence over the packed one)
+  {
+    fs::create_directories( repo / "refs" / "heads" );
+    std::ofstream ref{( repo / "refs" / "heads" / "master" ).string()};
+    ref << db.pin( "v0" ).id() << '\n';
+  }
+  db.disconnect(); // drop the cached root trees
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 200} ) ), v0_data );
+
+  EXPECT_EQ( std::get<0>( view.get( "Cond", 200 ) ), v1_data );
+  EXPECT_EQ( std::get<0>( view.get_payload( "Cond", 200 ) ).str(), v1_data );
+  EXPECT_EQ( view.iov_boundaries( "Cond" ), db.iov_boundaries( "v1", "Cond" ) );
+  EXPECT_EQ( view.iovs( "Cond" ).size(), db.iovs( "v1", "Cond" ).size() );
+  EXPECT_EQ( std::get<0>( view.cursor( "Cond" ).at( 200 ) ).str(), v1_data );
+  EXPECT_EQ( view.commit_time(), db.commit_time( "v1" ) );
+
+  fs::remove_all( repo );
+
+  // no-op for the other backends
+  CondDB     json_db   = connect( R"(json:{"Cond": "data"})" );
+  const auto json_view = json_db.pin( "HEAD" );
+  EXPECT_EQ( json_view.id(), "HEAD" );
+  EXPECT_EQ( std::get<0>( json_view.get( "Cond", 0 ) ), "data" );
+}
+
+TEST( CondDB, ContentId ) {
+  CondDB     db = connect( "test_data/repo.git" );
+  const auto id = db.content_id( {"HEAD", "Cond", 110} );
+  EXPECT_EQ( id.size(), 40 );
+  // the id of the payload, resolving the nested IOVs
+  EXPECT_EQ( id, db.content_id( {"HEAD", "Cond/v1", 0} ) );
+  EXPECT_EQ( id, db.content_id( {"HEAD", "Cond", 140} ) );
+  EXPECT_NE( id, db.content_id( {"HEAD", "Cond", 0} ) );
+  EXPECT_FALSE( db.content_id( {"HEAD", "TheDir", 0} ).empty() );
+  EXPECT_TRUE( db.content_id( {"HEAD", "NoSuchPath", 0} ).empty() );
+
+  // no ids for files that are not watched
+  EXPECT_TRUE( connect( "file:test_data/repo" ).content_id( {"HEAD", "Cond", 110} ).empty() );
+}
+
+TEST( CondDB, Stats ) {
+  CondDB db = connect( "test_data/repo" );
+
+  auto stats = db.stats();
+  EXPECT_EQ( stats.backend, "git" );
+  EXPECT_EQ( stats.lookups, 0 );
+  EXPECT_EQ( stats.objects, 0 );
+
+  EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 110} ) ), "data 1" );
+  EXPECT_EQ( std::get<0>( db.get( {"v1", "Cond", 120} ) ), "data 1" );
+
+  stats = db.stats();
+  EXPECT_EQ( stats.lookups, 2 );
+  EXPECT_EQ( stats.lookup_latency.count, 2 );
+  EXPECT_GT( stats.lookup_latency.total.count(), 0 );
+  EXPECT_EQ( stats.objects, stats.read_latency.count );
+  EXPECT_GE( stats.bytes, 2 * std::string{"data 1"}.size() );
+  EXPECT_EQ( stats.iov_cache.misses, 2 ); // Cond/IOVs and Cond/group/IOVs
+  EXPECT_EQ( stats.iov_cache.hits, 0 );   // the second lookup uses the flattened IOVs
+  EXPECT_EQ( stats.iov_parse_latency.count, 2 );
+
+  const auto dump = stats.dump();
+  EXPECT_NE( dump.find( "gitconddb_lookups_total{backend=\"git\"} 2\n" ), dump.npos );
+  EXPECT_NE( dump.find( "gitconddb_lookup_latency_seconds_count{backend=\"git\"} 2\n" ), dump.npos );
+  EXPECT_NE( dump.find( "gitconddb_lookup_latency_seconds_bucket{backend=\"git\",le=\"+Inf\"} 2\n" ), dump.npos );
+
+  db.reset_stats();
+  stats = db.stats();
+  EXPECT_EQ( stats.lookups, 0 );
+  EXPECT_EQ( stats.objects, 0 );
+  EXPECT_EQ( stats.lookup_latency.count, 0 );
+  EXPECT_EQ( stats.iov_cache.hits, 0 );
+
+  // cursors count the lookups outside of the current IOV
+  auto cursor = db.cursor( "v1", "Cond" );
+  for ( auto t : {110, 120, 160, 210, 220} ) cursor.at( t );
+  stats = db.stats();
+  EXPECT_EQ( stats.lookups, 3 );
+  EXPECT_EQ( stats.lookup_latency.count, 3 );
+
+  EXPECT_EQ( connect( "file:test_data/repo" ).stats().backend, "file" );
+}
+
+TEST( CondDB, FileWatch ) {
+  const auto root  = make_temp_dir( "test_GitCondDB_watch" );
+  const auto write = [&root]( const std::string& name, std::string_view data ) {
+    std::ofstream{( root / name ).string()} << data;
+  };
+  fs::create_directories( root / "Cond" );
+  write( "Cond/IOVs", "0 v0\n100 v1\n" );
+  write( "Cond/v0", "data 0" );
+  write( "Cond/v1", "data 1" );
+
+  ConnectOptions options;
+  options.file_watch = true;
+  CondDB db          = connect( "file:" + root.string(), options );
+  db.set_payload_cache_size( 1024 * 1024 );
+
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "data 0" );
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "data 0" );
+  EXPECT_EQ( db.payload_cache_stats().hits, 1 );
+  EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 100} ) );
+
+  // only what changed is read again
+  write( "Cond/v0", "new data 0" );
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "new data 0" );
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 150} ) ), "data 1" );
+  EXPECT_EQ( db.stats().iov_cache.misses, 2 ); // Cond/IOVs parsed with and without IOVs reduction
+
+  write( "Cond/IOVs", "0 v0\n200 v1\n" );
+  const auto [data, iov] = db.get( {"HEAD", "Cond", 150} );
+  EXPECT_EQ( data, "new data 0" );
+  EXPECT_EQ( iov.until, 200 );
+  EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 200} ) );
+  EXPECT_EQ( db.stats().iov_cache.misses, 4 );
+
+  fs::remove_all( root );
+}
+
+TEST( CondDB, CompressedPayloads ) {
+  using GitCondDB::Helpers::gzip;
+  const auto root  = make_temp_dir( "test_GitCondDB_gzip" );
+  const auto write = [&root]( const std::string& name, std::string_view data ) {
+    std::ofstream{( root / name ).string(), std::ios::binary} << data;
+  };
+  fs::create_directories( root / "Cond" );
+  write( "Cond/IOVs", gzip( "0 v0\n100 v1\n" ) );
+  write( "Cond/v0", gzip( "data 0" ) );
+  write( "Cond/v1", "data 1" );
+
+  // not compressed, but with the same header
+  const std::string gzip_like = "\x1f\x8b\x08 not really gzip";
+  write( "Raw", gzip_like );
+
+  ConnectOptions options;
+  options.file_watch = true; // to get content ids, hence caching
+  {
+    // payloads are returned as they are by default
+    CondDB raw_db = connect( "file:" + root.string(), options );
+    EXPECT_EQ( std::get<0>( raw_db.get( {"HEAD", "Raw", 0} ) ), gzip_like );
+    EXPECT_EQ( std::get<0>( raw_db.get( {"HEAD", "Cond/v0", 0} ) ), gzip( "data 0" ) );
+    EXPECT_EQ( std::get<0>( raw_db.get( {"HEAD", "Cond/v1", 0} ) ), "data 1" );
+  }
+
+  options.decompress_payloads = true;
+  CondDB db                   = connect( "file:" + root.string(), options );
+  db.set_payload_cache_size( 1024 * 1024 );
+
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "data 0" );
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "data 0" );
+  EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 150} ) ), "data 1" );
+  EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 100} ) );
+
+  // the cache holds the decompressed data
+  const auto cache = db.payload_cache_stats();
+  EXPECT_EQ( cache.hits, 1 );
+  EXPECT_EQ( cache.entries, 2 );
+  EXPECT_EQ( cache.bytes, 12 );
+
+  fs::remove_all( root );
+}
+
+TEST( CondDB, BinaryIOVs ) {
+  using namespace GitCondDB::Helpers;
+  const auto root  = make_temp_dir( "test_GitCondDB_binary_iovs" );
+  const auto write = [&root]( const std::string& name, std::string_view data ) {
+    std::ofstream{( root / name ).string(), std::ios::binary} << data;
+  };
+  const std::string text = "0 v0\n100 v1\n";
+  // different boundaries, but marked as generated from the text file, to tell which file is used
+  auto binary = to_binary_IOVs( "0 v0\n150 v1\n" );
+  binary.replace( binary_IOVs::text_identity_pos, 12, to_binary_IOVs( text ), binary_IOVs::text_identity_pos, 12 );
+  fs::create_directories( root / "Cond" );
+  write( "Cond/IOVs", text );
+  write( "Cond/IOVs.bin", binary );
+  write( "Cond/v0", "data 0" );
+  write( "Cond/v1", "data 1" );
+
+  {
+    CondDB db = connect( "file:" + root.string() );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 120} ) ), "data 0" );
+    EXPECT_EQ( std::get<1>( db.cursor( "HEAD", "Cond" ).at( 160 ) ).since, 150 );
+    EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 150} ) );
+  }
+
+  // the binary file is ignored if the text file was modified after it was generated
+  write( "Cond/IOVs", "0 v0\n120 v1\n" );
+  {
+    CondDB db = connect( "file:" + root.string() );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 130} ) ), "data 1" );
+    EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 120} ) );
+  }
+
+  fs::remove( root / "Cond" / "IOVs.bin" );
+  {
+    CondDB db = connect( "file:" + root.string() );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 130} ) ), "data 1" );
+    EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 120} ) );
+  }
+
+  // without the text file, a directory is not a condition
+  fs::create_directories( root / "Dir" / "Sub" );
+  write( "Dir/Sub/IOVs.bin", to_binary_IOVs( text ) );
+  {
+    CondDB db = connect( "file:" + root.string() );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Dir", 0} ) ), R"({"dirs":["Sub"],"files":[],"root":"Dir"})" );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Dir/Sub", 0} ) ),
+               R"({"dirs":[],"files":["IOVs.bin"],"root":"Dir/Sub"})" );
+  }
+
+  fs::remove_all( root );
+}
+
+TEST( CondDB, FlattenedIOVs ) {
+  // a condition partitioned on two levels, as written by partition_iovs
+  CondDB db = connect( R"(json:
+                       {"Cond": {"IOVs": "0 v0\n100 2018\n300 2019\n",
+                                 "v0": "data 0",
+                                 "v1": "data 1",
+                                 "v2": "data 2",
+                                 "2018": {"IOVs": "100 ../v1\n150 ../v1\n200 q2\n",
+                                          "q2": {"IOVs": "200 ../../v2\n250 ../../v1\n"}},
+                                 "2019": {"IOVs": "300 ../v2\n"}}}
+                       )" );
+
+  using IOV        = CondDB::IOV;
+  using expected_t = std::vector<std::tuple<std::string, IOV>>;
+  const expected_t reduced     = {{"data 0", {0, 100}},   {"data 1", {100, 200}}, {"data 2", {200, 250}},
+                                  {"data 1", {250, 300}}, {"data 2", {300, IOV::max()}}};
+  const expected_t not_reduced = {{"data 0", {0, 100}},   {"data 1", {100, 150}}, {"data 1", {150, 200}},
+                                  {"data 2", {200, 250}}, {"data 1", {250, 300}}, {"data 2", {300, IOV::max()}}};
+
+  for ( bool reduce : {true, false} ) {
+    db.set_iov_reduction( reduce );
+    const auto& expected = reduce ? reduced : not_reduced;
+    db.get( {"HEAD", "Cond", 0} );
+    const auto misses = db.stats().iov_cache.misses;
+    for ( const auto& [data, iov] : expected ) {
+      for ( auto t : {iov.since, ( iov.since + std::min( iov.until, CondDB::time_point_t{400} ) ) / 2} ) {
+        const auto [got_data, got_iov] = db.get( {"HEAD", "Cond", t} );
+        EXPECT_EQ( got_data, data ) << "t=" << t << " reduce=" << reduce;
+        EXPECT_EQ( got_iov.since, iov.since ) << "t=" << t << " reduce=" << reduce;
+        EXPECT_EQ( got_iov.until, iov.until ) << "t=" << t << " reduce=" << reduce;
+      }
+    }
+    // the nested tables are read only when the condition is first looked up
+    EXPECT_EQ( db.stats().iov_cache.misses, misses );
+  }
+
+  // cursors use the flattened IOVs too
+  const auto hits = db.stats().iov_cache.hits;
+  for ( bool reduce : {true, false} ) {
+    db.set_iov_reduction( reduce );
+    auto cursor = db.cursor( "HEAD", "Cond" );
+    for ( const auto& [data, iov] : reduce ? reduced : not_reduced ) {
+      const auto [got_data, got_iov] = cursor.at( iov.since );
+      EXPECT_EQ( got_data.str(), data ) << "t=" << iov.since << " reduce=" << reduce;
+      EXPECT_EQ( got_iov.since, iov.since ) << "t=" << iov.since << " reduce=" << reduce;
+      EXPECT_EQ( got_iov.until, iov.until ) << "t=" << iov.since << " reduce=" << reduce;
+    }
+  }
+  EXPECT_EQ( db.stats().iov_cache.hits, hits );
+
+  // the boundaries, still computed from the nested tables, match
+  EXPECT_EQ( db.iov_boundaries( "HEAD", "Cond" ), ( std::vector<CondDB::time_point_t>{0, 100, 150, 200, 250, 300} ) );
+}
+
+TEST( CondDB, FlattenedIOVsCache ) {
+  const std::string doc = R"(json:
+                          {"Cond": {"IOVs": "0 v0\n100 2018\n", "v0": "data 0", "v1": "data 1",
+                                    "2018": {"IOVs": "100 ../v1\n"}},
+                           "Other": {"IOVs": "0 v0\n", "v0": "other"},
+                           "Plain": "plain",
+                           "Dir": {"File": "file"}}
+                          )";
+  {
+    CondDB db = connect( doc );
+    // only conditions are flattened, the other objects get an empty table so that they are checked once
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Plain", 0} ) ), "plain" );
+    db.get( {"HEAD", "Dir", 0} );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Dir/File", 0} ) ), "file" );
+    auto stats = db.stats().flat_iovs_cache;
+    EXPECT_EQ( stats.entries, 3 );
+    EXPECT_EQ( stats.misses, 3 );
+    const auto empty_bytes = stats.bytes;
+
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Plain", 0} ) ), "plain" );
+    stats = db.stats().flat_iovs_cache;
+    EXPECT_EQ( stats.misses, 3 );
+    EXPECT_EQ( stats.hits, 1 );
+
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 150} ) ), "data 1" );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Other", 10} ) ), "other" );
+    stats = db.stats().flat_iovs_cache;
+    EXPECT_EQ( stats.entries, 5 );
+    EXPECT_GT( stats.bytes, empty_bytes );
+  }
+  {
+    ConnectOptions options;
+    options.flat_iovs_cache_size = 0;
+    CondDB db                    = connect( doc, options );
+    // without the cache, the lookups go through the nested tables
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 50} ) ), "data 0" );
+    EXPECT_EQ( std::get<0>( db.get( {"HEAD", "Cond", 150} ) ), "data 1" );
+    EXPECT_EQ( std::get<1>( db.get( {"HEAD", "Cond", 150} ) ).since, 100 );
+    EXPECT_EQ( db.stats().flat_iovs_cache.entries, 0 );
+  }
+}
+
 int main( int argc, char** argv ) {
   ::testing::InitGoogleTest( &argc, argv );
   return RUN_ALL_TESTS();
@@ -18,7 +18,9 @@
 
 #include "gtest/gtest.h"
 
-using namespace GitCondDB::v1;
+#include <fstream>
+
+using namespace GitCondDB::v2;
 
 TEST( FSImpl, Connection ) {
   auto logger = std::make_shared<CapturingLogger>();
@@ -95,6 +97,129 @@ TEST( FSImpl, Access ) {
   EXPECT_EQ( db.commit_time( "HEAD" ), std::chrono::time_point<std::chrono::system_clock>::max() );
 }
 
+namespace {
+  /// Temporary copy of a few files, removed on destruction.
+  struct TempRepo {
+    const fs::path root = make_temp_dir( "test_GitCondDB_FS" );
+
+    TempRepo() {
+      fs::create_directories( root / "Cond" );
+      write( "Cond/small", "small payload" );
+      write( "Cond/large", std::string( 100000, 'x' ) + "end" );
+    }
+    ~TempRepo() { fs::remove_all( root ); }
+
+    void write( const std::string& name, std::string_view data ) const {
+      std::ofstream{( root / name ).string()} << data;
+    }
+  };
+} // namespace
+
+TEST( FSImpl, LargeFiles ) {
+  TempRepo repo;
+
+  for ( std::size_t threshold : {0, 1024, 1000000} ) {
+    ConnectOptions options;
+    options.file_mmap_threshold = threshold;
+    details::FilesystemImpl db{repo.root.string(), nullptr, options};
+
+    EXPECT_EQ( std::get<0>( db.get( "HEAD:Cond/small" ) ), "small payload" );
+    const auto large = std::get<0>( db.get_payload( "HEAD:Cond/large" ) );
+    EXPECT_EQ( large.size(), 100003 );
+    EXPECT_EQ( large.view().substr( 99998 ), "xxend" );
+
+    const auto cont = std::get<1>( db.get( "HEAD:Cond" ) );
+    EXPECT_EQ( cont.dirs, std::vector<std::string>{} );
+    EXPECT_EQ( cont.files.size(), 2 );
+  }
+}
+
+TEST( FSImpl, NoMappingWhenWatching ) {
+  TempRepo repo;
+
+  ConnectOptions options;
+  options.file_mmap_threshold = 1024;
+  options.file_watch          = true;
+  details::FilesystemImpl db{repo.root.string(), nullptr, options};
+
+  const auto large = std::get<0>( db.get_payload( "HEAD:Cond/large" ) );
+  repo.write( "Cond/large", std::string( 100003, 'y' ) ); // rewritten in place
+  EXPECT_EQ( large.size(), 100003 );
+  EXPECT_EQ( large.view().substr( 99998 ), "xxend" );
+}
+
+TEST( FSImpl, MetadataCache ) {
+  TempRepo repo;
+
+  ConnectOptions options;
+  details::FilesystemImpl no_cache{repo.root.string(), nullptr, options};
+  options.file_metadata_ttl = std::chrono::hours{1};
+  details::FilesystemImpl cached{repo.root.string(), nullptr, options};
+
+  for ( const auto* db : {&no_cache, &cached} ) {
+    EXPECT_TRUE( db->exists( "HEAD:Cond/small" ) );
+    EXPECT_FALSE( db->exists( "HEAD:Cond/new" ) );
+  }
+
+  repo.write( "Cond/new", "new payload" );
+  fs::remove( repo.root / "Cond" / "small" );
+
+  EXPECT_TRUE( no_cache.exists( "HEAD:Cond/new" ) );
+  EXPECT_FALSE( no_cache.exists( "HEAD:Cond/small" ) );
+  EXPECT_EQ( std::get<0>( no_cache.get( "HEAD:Cond/new" ) ), "new payload" );
+
+  // the cached information is still used, until it expires
+  EXPECT_FALSE( cached.exists( "HEAD:Cond/new" ) );
+  EXPECT_TRUE( cached.exists( "HEAD:Cond/small" ) );
+  EXPECT_THROW( cached.get( "HEAD:Cond/new" ), std::runtime_error );
+  EXPECT_THROW( cached.get( "HEAD:Cond/small" ), std::runtime_error );
+
+  // the size of the files is not taken from the cache
+  EXPECT_EQ( std::get<0>( cached.get( "HEAD:Cond/large" ) ).size(), 100003 );
+  repo.write( "Cond/large", std::string( 200000, 'y' ) + "end" );
+  EXPECT_EQ( std::get<0>( cached.get( "HEAD:Cond/large" ) ).size(), 200003 );
+}
+
+TEST( FSImpl, Watch ) {
+  TempRepo repo;
+
+  ConnectOptions          options;
+  details::FilesystemImpl plain{repo.root.string(), nullptr, options};
+  EXPECT_FALSE( plain.has_content_ids() );
+  EXPECT_EQ( plain.content_id( "HEAD:Cond/small" ), "" );
+
+  options.file_watch = true;
+  details::FilesystemImpl db{repo.root.string(), nullptr, options};
+  EXPECT_TRUE( db.has_content_ids() );
+
+  const auto file_id  = db.content_id( "HEAD:Cond/small" );
+  const auto other_id = db.content_id( "HEAD:Cond/large" );
+  const auto dir_id   = db.content_id( "HEAD:Cond" );
+  EXPECT_FALSE( file_id.empty() );
+  EXPECT_NE( file_id, other_id );
+  EXPECT_NE( file_id, dir_id );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/small" ), file_id );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/new" ), "" );
+  EXPECT_EQ( db.conditions_listing( "HEAD:Cond", std::get<1>( db.get( "HEAD:Cond" ) ) )->files.size(), 2 );
+
+  // adding a file changes the ids of the directories above it, and only them
+  repo.write( "Cond/new", "new payload" );
+  EXPECT_FALSE( db.content_id( "HEAD:Cond/new" ).empty() );
+  EXPECT_NE( db.content_id( "HEAD:Cond" ), dir_id );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/small" ), file_id );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/large" ), other_id );
+  EXPECT_EQ( db.conditions_listing( "HEAD:Cond", std::get<1>( db.get( "HEAD:Cond" ) ) )->files.size(), 3 );
+  EXPECT_EQ( db.stats().listing_misses, 2 );
+
+  repo.write( "Cond/small", "changed payload" );
+  EXPECT_NE( db.content_id( "HEAD:Cond/small" ), file_id );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/large" ), other_id );
+
+  fs::remove( repo.root / "Cond" / "small" );
+  EXPECT_EQ( db.content_id( "HEAD:Cond/small" ), "" );
+  EXPECT_FALSE( db.exists( "HEAD:Cond/small" ) );
+}
+
 int main( int argc, char** argv ) {
   ::testing::InitGoogleTest( &argc, argv );
   return RUN_ALL_TESTS();
@@ -18,7 +18,10 @@
 
 #include "gtest/gtest.h"
 
-using namespace GitCondDB::v1;
+#include <atomic>
+#include <thread>
+
+using namespace GitCondDB::v2;
 
 TEST( GitImpl, Connection ) {
   auto logger = std::make_shared<CapturingLogger>();
@@ -105,6 +108,176 @@ TEST( GitImpl, FailAccess ) {
 
 TEST( GitImpl, AccessBare ) { access_test( details::GitImpl{"test_data/repo.git"} ); }
 
+TEST( GitImpl, TagCache ) {
+  details::GitImpl db{"test_data/repo.git"};
+
+  // different tags resolve to different trees
+  EXPECT_EQ( std::get<0>( db.get( "v0:Cond/IOVs" ) ), "0 v0\n100 group\n" );
+  EXPECT_EQ( std::get<0>( db.get( "v1:Cond/IOVs" ) ), "0 v0\n100 group\n200 v3\n" );
+  EXPECT_EQ( std::get<0>( db.get( "v1:Cond/group/IOVs" ) ), "50 ../v1\n150 ../v2\n" );
+  EXPECT_TRUE( db.exists( "v0:Cond/group" ) );
+  EXPECT_FALSE( db.exists( "v0:Cond/v2" ) );
+  EXPECT_TRUE( db.exists( "v1:Cond/v2" ) );
+  EXPECT_TRUE( db.exists( "v1:" ) );
+
+  // tag expressions are accepted as with git_revparse_single
+  EXPECT_EQ( std::get<0>( db.get( "v1~1:Cond/IOVs" ) ), "0 v0\n100 group\n" );
+  // even if they contain ':'
+  EXPECT_EQ( std::get<0>( db.get( "HEAD^{/first: message}:Cond/IOVs" ) ), "0 v0\n100 group\n" );
+  EXPECT_TRUE( db.exists( "HEAD^{/first: message}:Cond/v1" ) );
+  EXPECT_FALSE( db.exists( "HEAD^{/first: message}:Cond/v2" ) );
+
+  // invalid tags
+  EXPECT_FALSE( db.exists( "no-tag:Cond" ) );
+  try {
+    db.get( "no-tag:Cond" );
+    FAIL() << "exception expected for invalid tag";
+  } catch ( std::runtime_error& err ) {
+    EXPECT_EQ( std::string_view{err.what()}.substr( 0, 33 ), "cannot resolve object no-tag:Cond" );
+  }
+
+  // the cache does not survive a disconnection
+  db.disconnect();
+  EXPECT_FALSE( db.connected() );
+  EXPECT_EQ( std::get<0>( db.get( "v1:Cond/v2" ) ), "data 2" );
+  EXPECT_TRUE( db.connected() );
+}
+
+TEST( GitImpl, ContentId ) {
+  details::GitImpl db{"test_data/repo.git"};
+
+  const auto id = db.content_id( "v0:Cond/v0" );
+  EXPECT_EQ( id.length(), 40 );
+  EXPECT_EQ( db.content_id( "v1:Cond/v0" ), id );
+  EXPECT_NE( db.content_id( "v0:Cond/IOVs" ), db.content_id( "v1:Cond/IOVs" ) );
+  EXPECT_NE( db.content_id( "v0:Cond" ), db.content_id( "v1:Cond" ) );
+  EXPECT_EQ( db.content_id( "v1:" ).length(), 40 );
+  EXPECT_EQ( db.content_id( "v1" ).length(), 40 );
+  EXPECT_EQ( db.content_id( "HEAD^{/first: message}:Cond/v0" ), id );
+
+  EXPECT_EQ( db.content_id( "v0:Cond/v2" ), "" );
+  EXPECT_EQ( db.content_id( "no-tag:Cond" ), "" );
+}
+
+TEST( GitImpl, IOVIndexCache ) {
+  details::GitImpl db{"test_data/repo.git"};
+
+  auto index = db.iov_index( "v1:Cond/IOVs", true );
+  EXPECT_EQ( index->size(), 3 );
+  EXPECT_EQ( index->key( 2 ), "v3" );
+
+  EXPECT_EQ( db.iov_index( "v1:Cond/IOVs", true ), index );
+  EXPECT_EQ( db.iov_index( "HEAD:Cond/IOVs", true ), index );
+  EXPECT_NE( db.iov_index( "v1:Cond/IOVs", false ), index );
+  EXPECT_NE( db.iov_index( "v0:Cond/IOVs", true ), index );
+}
+
+TEST( GitImpl, ConditionsListing ) {
+  details::GitImpl db{"test_data/repo.git"};
+
+  auto listing = db.conditions_listing( "v1:", std::get<1>( db.get( "v1:" ) ) );
+  EXPECT_EQ( listing->dirs, std::vector<std::string>{"TheDir"} );
+  EXPECT_EQ( listing->files, std::vector<std::string>{"Cond"} );
+
+  listing = db.conditions_listing( "v1:Cond", std::get<1>( db.get( "v1:Cond" ) ) );
+  EXPECT_EQ( listing->dirs, std::vector<std::string>{} );
+  EXPECT_EQ( listing->files, ( std::vector<std::string>{"IOVs", "group", "v0", "v1", "v2", "v3"} ) );
+
+  EXPECT_EQ( db.conditions_listing( "HEAD:Cond", {} ), listing );
+}
+
+TEST( GitImpl, LazyLogging ) {
+  struct FilteringLogger : CapturingLogger {
+    bool enabled( Level msg_level ) const override { return level <= msg_level; }
+  };
+  auto logger = std::make_shared<FilteringLogger>();
+
+  details::GitImpl db{"test_data/repo.git", logger};
+  EXPECT_EQ( logger->size(), 0 ); // info not enabled at Quiet level
+
+  int  formatted = 0;
+  auto message   = [&formatted]() {
+    ++formatted;
+    return std::string{"expensive message"};
+  };
+  db.debug( message );
+  db.info( message );
+  EXPECT_EQ( formatted, 0 );
+  db.warning( message );
+  EXPECT_EQ( formatted, 1 );
+  EXPECT_TRUE( logger->contains( "expensive message" ) );
+
+  EXPECT_EQ( std::get<0>( db.get( "HEAD:TheDir/TheFile.txt" ) ), "some data\n" );
+  EXPECT_EQ( logger->size(), 1 );
+
+  logger->level = Logger::Level::Debug;
+  EXPECT_EQ( std::get<0>( db.get( "HEAD:TheDir/TheFile.txt" ) ), "some data\n" );
+  EXPECT_TRUE( logger->contains( 1, "get Git object HEAD:TheDir/TheFile.txt" ) );
+
+  EXPECT_FALSE( details::NullLogger{}.enabled( Logger::Level::Quiet ) );
+}
+
+TEST( GitImpl, LibraryOptions ) {
+  GitCondDB::Helpers::git_library library;
+
+  std::size_t mwindow_size = 0;
+  git_libgit2_opts( GIT_OPT_GET_MWINDOW_SIZE, &mwindow_size );
+  ssize_t current = 0, cache_max_size = 0;
+  git_libgit2_opts( GIT_OPT_GET_CACHED_MEMORY, &current, &cache_max_size );
+
+  ConnectOptions options;
+  options.git_mwindow_size     = 1024 * 1024;
+  options.git_cache_max_size   = 32 * 1024 * 1024;
+  options.git_cache_blob_limit = 4096;
+  {
+    details::GitImpl db{"test_data/repo.git", nullptr, options};
+    EXPECT_EQ( std::get<0>( db.get( "HEAD:TheDir/TheFile.txt" ) ), "some data\n" );
+
+    std::size_t value = 0;
+    git_libgit2_opts( GIT_OPT_GET_MWINDOW_SIZE, &value );
+    EXPECT_EQ( value, options.git_mwindow_size );
+    ssize_t max_size = 0;
+    git_libgit2_opts( GIT_OPT_GET_CACHED_MEMORY, &current, &max_size );
+    EXPECT_EQ( max_size, static_cast<ssize_t>( options.git_cache_max_size ) );
+  }
+
+  // settings left to 0 are not changed
+  {
+    details::GitImpl db{"test_data/repo.git", nullptr, ConnectOptions{}};
+    std::size_t      value = 0;
+    git_libgit2_opts( GIT_OPT_GET_MWINDOW_SIZE, &value );
+    EXPECT_EQ( value, options.git_mwindow_size );
+  }
+
+  git_libgit2_opts( GIT_OPT_SET_MWINDOW_SIZE, mwindow_size );
+  git_libgit2_opts( GIT_OPT_SET_CACHE_MAX_SIZE, cache_max_size );
+  git_libgit2_opts( GIT_OPT_SET_CACHE_OBJECT_LIMIT, GIT_OBJ_BLOB, std::size_t{0} );
+}
+
+TEST( GitImpl, ConcurrentAccess ) {
+  details::GitImpl db{"test_data/repo.git", nullptr, 4};
+  EXPECT_TRUE( db.connected() );
+
+  std::atomic<int>         errors{0};
+  std::vector<std::thread> threads;
+  for ( int t = 0; t < 8; ++t ) {
+    threads.emplace_back( [&db, &errors]() {
+      for ( int i = 0; i < 200; ++i ) {
+        if ( std::get<0>( db.get( "v1:Cond/v2" ) ) != "data 2" ) ++errors;
+        if ( std::get<0>( db.get( "v0:Cond/IOVs" ) ) != "0 v0\n100 group\n" ) ++errors;
+        if ( !db.exists( "v1:Cond/group" ) ) ++errors;
+      }
+    } );
+  }
+  for ( auto& thread : threads ) thread.join();
+  EXPECT_EQ( errors.load(), 0 );
+
+  db.disconnect();
+  EXPECT_FALSE( db.connected() );
+  EXPECT_EQ( std::get<0>( db.get( "v1:Cond/v2" ) ), "data 2" );
+  EXPECT_TRUE( db.connected() );
+}
+
 int main( int argc, char** argv ) {
   ::testing::InitGoogleTest( &argc, argv );
   return RUN_ALL_TESTS();
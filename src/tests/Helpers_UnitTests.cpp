@@ -12,11 +12,27 @@
 #include "GitCondDB.h"
 
 #include "DBImpl.h"
+#include "compression_helpers.h"
+#include "export_helpers.h"
 #include "iov_helpers.h"
+#include "path_helpers.h"
+#include "stats_helpers.h"
+#include "worker_helpers.h"
+
+#include "test_common.h"
 
 #include "gtest/gtest.h"
 
-using namespace GitCondDB::v1;
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <thread>
+
+using namespace GitCondDB::v2;
 
 TEST( IOVHelpers, ParseIOVs ) {
   using GitCondDB::Helpers::get_key_iov;
@@ -77,8 +93,513 @@ TEST( IOVHelpers, ParseIOVs ) {
   }
 }
 
+TEST( IOVHelpers, IOVIndex ) {
+  using GitCondDB::Helpers::parse_IOVs_index;
+
+  const std::string test_data{"0 a\n"
+                              "100 b\n"
+                              "150 b\n"
+                              "  200\tc \r\n"
+                              "\n"
+                              "invalid line\n"
+                              "300 a"};
+
+  {
+    const auto index = parse_IOVs_index( test_data, false );
+    EXPECT_EQ( index.size(), 5 );
+    EXPECT_EQ( index.keys, ( std::vector<std::string>{"a", "b", "c"} ) );
+    EXPECT_EQ( index.key( 4 ), "a" );
+    EXPECT_EQ( index.iov( 1 ).since, 100 );
+    EXPECT_EQ( index.iov( 1 ).until, 150 );
+    EXPECT_EQ( index.iov( 4 ).until, CondDB::IOV::max() );
+
+    auto [key, iov] = index.find( 170 );
+    EXPECT_EQ( key, "b" );
+    EXPECT_EQ( iov.since, 150 );
+    EXPECT_EQ( iov.until, 200 );
+  }
+  {
+    const auto index = parse_IOVs_index( test_data );
+    EXPECT_EQ( index.size(), 4 );
+
+    auto [key, iov] = index.find( 170 );
+    EXPECT_EQ( key, "b" );
+    EXPECT_EQ( iov.since, 100 );
+    EXPECT_EQ( iov.until, 200 );
+  }
+  {
+    const auto index = parse_IOVs_index( "100 a\n" );
+
+    auto [key, iov] = index.find( 50, {10, 1000} );
+    EXPECT_TRUE( iov.valid() );
+    EXPECT_EQ( key, "" );
+    EXPECT_EQ( iov.since, 10 );
+    EXPECT_EQ( iov.until, 100 );
+  }
+  {
+    const auto index = parse_IOVs_index( "" );
+    EXPECT_TRUE( index.empty() );
+
+    auto [key, iov] = index.find( 50 );
+    EXPECT_EQ( key, "" );
+    EXPECT_EQ( iov.since, 0 );
+    EXPECT_EQ( iov.until, CondDB::IOV::max() );
+  }
+}
+
+namespace {
+  /// original (linear scan) implementation of get_key_iov, used as reference
+  std::tuple<std::string, CondDB::IOV> reference_get_key_iov( const std::string& data, const CondDB::time_point_t t,
+                                                              const CondDB::IOV& boundaries, const bool reduce_iovs ) {
+    std::tuple<std::string, CondDB::IOV> out;
+    auto&                                key   = std::get<0>( out );
+    auto&                                since = std::get<1>( out ).since;
+    auto&                                until = std::get<1>( out ).until;
+
+    if ( t < boundaries.since || t >= boundaries.until ) {
+      since = until = 0;
+    } else {
+      CondDB::time_point_t current = 0;
+      std::string          line;
+      std::istringstream   stream{data};
+      std::string          tmp_key;
+      while ( std::getline( stream, line ) ) {
+        std::istringstream is{line};
+        is >> current >> tmp_key;
+        if ( !reduce_iovs || tmp_key != key ) {
+          if ( current > t ) {
+            until = current;
+            break;
+          }
+          key   = std::move( tmp_key );
+          since = current;
+        }
+      }
+      std::get<1>( out ).cut( boundaries );
+    }
+    return out;
+  }
+} // namespace
+
+TEST( IOVHelpers, IOVIndexHint ) {
+  std::string data;
+  for ( int i = 0; i < 50; ++i ) data += std::to_string( 100 + i * 10 ) + " key" + std::to_string( i ) + '\n';
+  const auto index = GitCondDB::Helpers::parse_IOVs_index( data );
+
+  for ( CondDB::time_point_t t = 0; t < 700; t += 5 ) {
+    const auto expected = index.next_position( t );
+    for ( std::size_t hint = 0; hint <= index.size() + 1; ++hint ) {
+      ASSERT_EQ( index.next_position( t, hint ), expected ) << "t=" << t << " hint=" << hint;
+    }
+  }
+
+  std::size_t position = 0;
+  for ( CondDB::time_point_t t = 0; t < 700; t += 3 ) {
+    const auto [key, iov]                   = index.find( t, {50, 600}, position );
+    const auto [expected_key, expected_iov] = index.find( t, {50, 600} );
+    ASSERT_EQ( key, expected_key ) << "t=" << t;
+    ASSERT_EQ( iov.since, expected_iov.since ) << "t=" << t;
+    ASSERT_EQ( iov.until, expected_iov.until ) << "t=" << t;
+  }
+}
+
+TEST( IOVHelpers, ParseIOVsEquivalence ) {
+  using GitCondDB::Helpers::get_key_iov;
+
+  std::string data;
+  for ( int i = 0; i < 300; ++i ) data += std::to_string( 100 + i * 10 ) + " key" + std::to_string( i % 7 / 3 ) + '\n';
+
+  for ( const bool reduce : {true, false} ) {
+    for ( const CondDB::IOV bounds : {CondDB::IOV{}, CondDB::IOV{1000, 2500}} ) {
+      for ( CondDB::time_point_t t = 0; t < 3200; t += 3 ) {
+        const auto expected = reference_get_key_iov( data, t, bounds, reduce );
+        const auto result   = get_key_iov( data, t, bounds, reduce );
+        ASSERT_EQ( std::get<0>( result ), std::get<0>( expected ) ) << "t=" << t << " reduce=" << reduce;
+        ASSERT_EQ( std::get<1>( result ).since, std::get<1>( expected ).since ) << "t=" << t << " reduce=" << reduce;
+        ASSERT_EQ( std::get<1>( result ).until, std::get<1>( expected ).until ) << "t=" << t << " reduce=" << reduce;
+      }
+    }
+  }
+}
+
+TEST( IOVHelpers, BinaryIOVs ) {
+  using namespace GitCondDB::Helpers;
+
+  std::string data;
+  for ( int i = 0; i < 300; ++i ) data += std::to_string( 100 + i * 10 ) + " key" + std::to_string( i % 7 / 3 ) + '\n';
+  const auto binary = to_binary_IOVs( data );
+  EXPECT_TRUE( is_binary_IOVs( binary ) );
+  EXPECT_FALSE( is_binary_IOVs( data ) );
+  EXPECT_EQ( binary.size(), 40 + 300 * 12 + 3 * 4 + 3 * 4 );
+
+  // the binary data records which text it was generated from
+  EXPECT_TRUE( binary_IOVs_match( binary, data ) );
+  EXPECT_FALSE( binary_IOVs_match( binary, data + "4000 key0\n" ) );
+  EXPECT_FALSE( binary_IOVs_match( binary, "0" + data.substr( 1 ) ) );
+  EXPECT_FALSE( binary_IOVs_match( data, data ) );
+
+  for ( const bool reduce : {true, false} ) {
+    const auto text_index   = parse_IOVs_index( data, reduce );
+    const auto binary_index = binary_IOVs_index( CondDB::Payload{binary}, reduce );
+    // the binary data is used as is, unless the IOVs have to be reduced
+    EXPECT_EQ( binary_index.binary.empty(), reduce );
+    ASSERT_EQ( binary_index.size(), text_index.size() );
+    for ( std::size_t i = 0; i < text_index.size(); ++i ) {
+      ASSERT_EQ( binary_index.key( i ), text_index.key( i ) ) << "i=" << i;
+      ASSERT_EQ( binary_index.iov( i ).since, text_index.iov( i ).since ) << "i=" << i;
+      ASSERT_EQ( binary_index.iov( i ).until, text_index.iov( i ).until ) << "i=" << i;
+    }
+    std::size_t position = 0;
+    for ( CondDB::time_point_t t = 0; t < 3200; t += 3 ) {
+      const auto [key, iov]                   = binary_index.find( t, {1000, 2500}, position );
+      const auto [expected_key, expected_iov] = text_index.find( t, {1000, 2500} );
+      ASSERT_EQ( key, expected_key ) << "t=" << t;
+      ASSERT_EQ( iov.since, expected_iov.since ) << "t=" << t;
+      ASSERT_EQ( iov.until, expected_iov.until ) << "t=" << t;
+    }
+  }
+
+  EXPECT_TRUE( binary_IOVs_index( CondDB::Payload{to_binary_IOVs( "" )} ).empty() );
+
+  // inconsistent data is rejected
+  EXPECT_THROW( binary_IOVs_index( CondDB::Payload{data} ), std::runtime_error );
+  EXPECT_THROW( binary_IOVs_index( CondDB::Payload{binary.substr( 0, binary.size() - 1 )} ), std::runtime_error );
+  auto bad_key_id = binary;
+  bad_key_id[40 + 300 * 8] = 3;
+  EXPECT_THROW( binary_IOVs_index( CondDB::Payload{bad_key_id} ), std::runtime_error );
+}
+
+TEST( CacheHelpers, LRU ) {
+  GitCondDB::Helpers::lru_cache<int> cache{0, 1};
+  EXPECT_FALSE( cache.enabled() );
+  cache.insert( "a", 1, 1 );
+  EXPECT_FALSE( cache.find( "a" ) );
+
+  cache.set_max_bytes( 10 );
+  EXPECT_TRUE( cache.enabled() );
+  cache.insert( "a", 1, 4 );
+  cache.insert( "b", 2, 4 );
+  EXPECT_EQ( cache.find( "a" ), 1 ); // "b" is now the least recently used
+  cache.insert( "c", 3, 4 );
+  EXPECT_EQ( cache.find( "a" ), 1 );
+  EXPECT_FALSE( cache.find( "b" ) );
+  EXPECT_EQ( cache.find( "c" ), 3 );
+
+  cache.insert( "too big", 4, 11 );
+  EXPECT_FALSE( cache.find( "too big" ) );
+
+  auto stats = cache.stats();
+  EXPECT_EQ( stats.hits, 3 );
+  EXPECT_EQ( stats.misses, 5 );
+  EXPECT_EQ( stats.evictions, 1 );
+  EXPECT_EQ( stats.entries, 2 );
+  EXPECT_EQ( stats.bytes, 8 );
+  EXPECT_EQ( stats.max_bytes, 10 );
+
+  cache.set_max_bytes( 5 );
+  stats = cache.stats();
+  EXPECT_EQ( stats.evictions, 2 );
+  EXPECT_EQ( stats.entries, 1 );
+  EXPECT_EQ( cache.find( "c" ), 3 );
+
+  cache.set_max_bytes( 10 );
+  cache.insert( "x:1", 1, 1 );
+  cache.insert( "x:2", 2, 2 );
+  cache.erase_if( []( std::string_view key ) { return key.substr( 0, 2 ) == "x:"; } );
+  stats = cache.stats();
+  EXPECT_EQ( stats.entries, 1 );
+  EXPECT_EQ( stats.bytes, 4 );
+  EXPECT_EQ( cache.find( "c" ), 3 );
+
+  cache.clear();
+  EXPECT_EQ( cache.stats().entries, 0 );
+  EXPECT_EQ( cache.stats().bytes, 0 );
+
+  // the shards share the budget
+  GitCondDB::Helpers::lru_cache<int> sharded{10, 4};
+  sharded.insert( "big", 1, 8 );
+  EXPECT_EQ( sharded.find( "big" ), 1 );
+  for ( int i = 0; i < 10; ++i ) sharded.insert( std::to_string( i ), i, 1 );
+  stats = sharded.stats();
+  EXPECT_LE( stats.bytes, 10 );
+  EXPECT_EQ( stats.entries + stats.evictions, 11 );
+}
+
+namespace {
+  /// original (regex based) implementation of the path normalization
+  std::string reference_normalize( std::string path ) {
+    static const std::regex ignored_re{"(/[^/]+/\\.\\./)|(/\\./)"};
+    std::string             old_path;
+    while ( old_path.length() != path.length() ) {
+      old_path.swap( path );
+      path = std::regex_replace( old_path, ignored_re, "/" );
+    }
+    return path;
+  }
+  std::string normalize( std::string path, std::size_t pos = 0 ) {
+    GitCondDB::Helpers::normalize_path( path, pos );
+    return path;
+  }
+} // namespace
+
+TEST( PathHelpers, Normalize ) {
+  EXPECT_EQ( normalize( "" ), "" );
+  EXPECT_EQ( normalize( "Cond/v1" ), "Cond/v1" );
+  EXPECT_EQ( normalize( "Cond/group/../v1" ), "Cond/v1" );
+  EXPECT_EQ( normalize( "group/../v1" ), "group/../v1" );
+  EXPECT_EQ( normalize( "/Cond/group/../v1" ), "/Cond/v1" );
+  EXPECT_EQ( normalize( "/a/./b/./c" ), "/a/b/c" );
+  EXPECT_EQ( normalize( "/a/b/c/../../d" ), "/a/d" );
+  EXPECT_EQ( normalize( "/a/b/.." ), "/a/b/.." );
+  EXPECT_EQ( normalize( "../a/./" ), "../a/" );
+  EXPECT_EQ( normalize( "/a//../b" ), "/a//../b" );
+  EXPECT_EQ( normalize( "/a/b/../../../c" ), "/../c" );
+  EXPECT_EQ( normalize( "/a/b/../../../../c" ), "/c" );
+  EXPECT_EQ( normalize( "v1/./x:/a/../b", 7 ), "v1/./x:/b" );
+}
+
+TEST( PathHelpers, NormalizeEquivalence ) {
+  // all strings made of '/', '.' and 'a' up to 10 characters
+  const char alphabet[] = {'/', '.', 'a'};
+  std::string path;
+  for ( std::size_t length = 0; length <= 10; ++length ) {
+    std::size_t count = 1;
+    for ( std::size_t i = 0; i < length; ++i ) count *= 3;
+    for ( std::size_t n = 0; n < count; ++n ) {
+      path.clear();
+      for ( std::size_t i = 0, x = n; i < length; ++i, x /= 3 ) path += alphabet[x % 3];
+      ASSERT_EQ( normalize( path ), reference_normalize( path ) ) << "path='" << path << "'";
+    }
+  }
+  // all paths of up to 6 entries taken from a small set
+  const std::string entries[] = {"", ".", "..", "a", "..."};
+  for ( std::size_t length = 1; length <= 6; ++length ) {
+    std::size_t count = 1;
+    for ( std::size_t i = 0; i < length; ++i ) count *= 5;
+    for ( std::size_t n = 0; n < count; ++n ) {
+      path.clear();
+      for ( std::size_t i = 0, x = n; i < length; ++i, x /= 5 ) {
+        if ( i ) path += '/';
+        path += entries[x % 5];
+      }
+      ASSERT_EQ( normalize( path ), reference_normalize( path ) ) << "path='" << path << "'";
+      ASSERT_EQ( normalize( "tag:" + path, 4 ), "tag:" + reference_normalize( path ) ) << "path='" << path << "'";
+    }
+  }
+}
+
+TEST( GitHelpers, ExclusivePool ) {
+  GitCondDB::Helpers::exclusive_pool<int> pool{2};
+  EXPECT_EQ( pool.size(), 2 );
+  {
+    auto a = pool.acquire();
+    auto b = pool.acquire();
+    EXPECT_NE( &*a, &*b );
+    *a = 1;
+    *b = 2;
+  }
+  EXPECT_EQ( *pool.acquire( 0 ) + *pool.acquire( 1 ), 3 );
+
+  // concurrent users never share an object
+  std::atomic<int>         errors{0};
+  std::vector<std::thread> threads;
+  for ( int t = 0; t < 4; ++t ) {
+    threads.emplace_back( [&pool, &errors, t]() {
+      for ( int i = 0; i < 1000; ++i ) {
+        auto value = pool.acquire();
+        *value     = t;
+        std::this_thread::yield();
+        if ( *value != t ) ++errors;
+      }
+    } );
+  }
+  for ( auto& thread : threads ) thread.join();
+  EXPECT_EQ( errors.load(), 0 );
+
+  // waiting threads (for any or a specific object) are woken up when the object is released
+  GitCondDB::Helpers::exclusive_pool<int> single{1};
+  auto                                    held = std::make_optional( single.acquire() );
+  std::atomic<int>                        woken{0};
+  threads.clear();
+  threads.emplace_back( [&single, &woken]() {
+    auto value = single.acquire();
+    ++woken;
+  } );
+  threads.emplace_back( [&single, &woken]() {
+    auto value = single.acquire( 0 );
+    ++woken;
+  } );
+  std::this_thread::sleep_for( std::chrono::milliseconds{20} );
+  EXPECT_EQ( woken.load(), 0 );
+  held.reset();
+  for ( auto& thread : threads ) thread.join();
+  EXPECT_EQ( woken.load(), 2 );
+}
+
+TEST( WorkerHelpers, BackgroundWorker ) {
+  std::vector<std::string> done;
+  {
+    GitCondDB::Helpers::background_worker worker{2, 2};
+    std::mutex                            wait_for_me;
+    {
+      std::lock_guard<std::mutex> guard( wait_for_me );
+      EXPECT_TRUE( worker.submit( "a", [&]() {
+        std::lock_guard<std::mutex> guard( wait_for_me );
+        done.emplace_back( "a" );
+      } ) );
+      EXPECT_FALSE( worker.submit( "a", [&]() { done.emplace_back( "a again" ); } ) );
+      EXPECT_TRUE( worker.submit( "b", [&]() { done.emplace_back( "b" ); } ) );
+    }
+    worker.wait();
+    EXPECT_EQ( done, ( std::vector<std::string>{"a", "b"} ) );
+
+    // recently executed tasks are ignored, until they are forgotten
+    EXPECT_FALSE( worker.submit( "a", [&]() { done.emplace_back( "a again" ); } ) );
+    EXPECT_TRUE( worker.submit( "d", [&]() { done.emplace_back( "d" ); } ) );
+    worker.wait();
+    EXPECT_EQ( done.back(), "d" );
+    EXPECT_TRUE( worker.submit( "a", [&]() { done.emplace_back( "a again" ); } ) );
+    worker.wait();
+    EXPECT_EQ( done.back(), "a again" );
+  }
+}
+
+TEST( WorkerHelpers, ThreadPool ) {
+  std::atomic<int> done{0};
+  {
+    GitCondDB::Helpers::thread_pool pool{3};
+    EXPECT_EQ( pool.size(), 3 );
+    for ( int i = 0; i < 100; ++i ) pool.submit( [&done]() { ++done; } );
+  }
+  // queued tasks are completed before the pool is destroyed
+  EXPECT_EQ( done.load(), 100 );
+}
+
+TEST( StatsHelpers, LatencyHistogram ) {
+  using namespace std::chrono_literals;
+  GitCondDB::Helpers::latency_histogram histogram;
+
+  histogram.record( 0ns );
+  histogram.record( 1ns );
+  histogram.record( 2ns );
+  histogram.record( 1000ns );
+  histogram.record( 1000s );
+
+  auto snapshot = histogram.snapshot();
+  EXPECT_EQ( snapshot.counts.size(), GitCondDB::Helpers::latency_histogram::n_buckets );
+  EXPECT_EQ( snapshot.count, 5 );
+  EXPECT_EQ( snapshot.total, 1000s + 1003ns );
+  EXPECT_EQ( snapshot.counts[0], 2 );
+  EXPECT_EQ( snapshot.counts[1], 1 );
+  EXPECT_EQ( snapshot.counts[9], 1 ); // 512 <= 1000 < 1024
+  EXPECT_EQ( snapshot.counts.back(), 1 );
+
+  histogram.reset();
+  snapshot = histogram.snapshot();
+  EXPECT_EQ( snapshot.count, 0 );
+  EXPECT_EQ( snapshot.total.count(), 0 );
+}
+
+namespace {
+  std::string read_text( const std::filesystem::path& path ) {
+    std::ifstream in( path, std::ios::binary );
+    return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  }
+} // namespace
+
+TEST( ExportHelpers, IncrementalExport ) {
+  using namespace GitCondDB::Helpers;
+  const auto tmp  = make_temp_dir( "test_export" );
+  const auto dest = tmp / "export";
+
+  const std::string doc = R"(json:{"Src": {"a.txt": "A", "sub": {"b.txt": "B", "c.txt": "C"},
+                                           "Cond": {"IOVs": "0 v0\n", "v0": "V0"}}})";
+  {
+    CondDB db = connect( doc );
+    EXPECT_TRUE( db.has_content_ids() );
+
+    auto result = export_directory( db, "HEAD", "Src", 0, dest, 2 );
+    EXPECT_TRUE( result.errors.empty() );
+    EXPECT_EQ( result.files, 4 );
+    EXPECT_EQ( result.written, 4 );
+    EXPECT_EQ( read_text( dest / "a.txt" ), "A" );
+    EXPECT_EQ( read_text( dest / "sub" / "c.txt" ), "C" );
+    EXPECT_EQ( read_text( dest / "Cond" ), "V0" );
+  }
+  {
+    // same content, new connection: the ids from the manifest match
+    CondDB db     = connect( doc );
+    auto   result = export_directory( db, "HEAD", "Src", 0, dest, 2 );
+    EXPECT_TRUE( result.errors.empty() );
+    EXPECT_EQ( result.written, 0 );
+    EXPECT_EQ( result.unchanged, 4 );
+    EXPECT_EQ( result.removed, 0 );
+  }
+  {
+    // one file changed and one removed
+    CondDB db = connect( R"(json:{"Src": {"a.txt": "A", "sub": {"b.txt": "B2"},
+                                          "Cond": {"IOVs": "0 v0\n", "v0": "V0"}}})" );
+    auto   result = export_directory( db, "HEAD", "Src", 0, dest, 2 );
+    EXPECT_TRUE( result.errors.empty() );
+    EXPECT_EQ( result.files, 3 );
+    EXPECT_EQ( result.written, 1 );
+    EXPECT_EQ( result.unchanged, 2 );
+    EXPECT_EQ( result.removed, 1 );
+    EXPECT_EQ( read_text( dest / "sub" / "b.txt" ), "B2" );
+    EXPECT_FALSE( std::filesystem::exists( dest / "sub" / "c.txt" ) );
+  }
+  {
+    // paths in the manifest outside of the destination are never removed
+    std::ofstream{tmp / "outside"} << "keep me";
+    std::ofstream{dest / export_manifest_name, std::ios::app} << "x\t../outside\nx\t" << ( tmp / "outside" ).string()
+                                                             << '\n';
+    CondDB db     = connect( doc );
+    auto   result = export_directory( db, "HEAD", "Src", 0, dest, 1 );
+    EXPECT_EQ( result.errors.size(), 2 );
+    EXPECT_EQ( read_text( tmp / "outside" ), "keep me" );
+    EXPECT_EQ( read_text( dest / "sub" / "c.txt" ), "C" );
+  }
+  {
+    CondDB db = connect( "test_data/repo.git" );
+    EXPECT_TRUE( db.has_content_ids() );
+    export_directory( db, "HEAD", "TheDir", 0, tmp / "git", 2 );
+    auto result = export_directory( db, "HEAD", "TheDir", 0, tmp / "git", 2 );
+    EXPECT_TRUE( result.errors.empty() );
+    EXPECT_GT( result.files, 0 );
+    EXPECT_EQ( result.written, 0 );
+  }
+
+  std::filesystem::remove_all( tmp );
+}
+
 using IOV = CondDB::IOV;
 
+TEST( CompressionHelpers, Gzip ) {
+  using namespace GitCondDB::Helpers;
+  const std::string data = []() {
+    std::string out;
+    for ( int i = 0; i < 10000; ++i ) out += "<entry id=\"" + std::to_string( i ) + "\">value</entry>\n";
+    return out;
+  }();
+
+  const auto compressed = gzip( data );
+  EXPECT_TRUE( is_gzip( compressed ) );
+  EXPECT_LT( compressed.size(), data.size() / 5 );
+  EXPECT_EQ( gunzip( compressed ), data );
+
+  EXPECT_FALSE( is_gzip( data ) );
+  EXPECT_FALSE( is_gzip( "" ) );
+  EXPECT_EQ( gunzip( gzip( "" ) ), "" );
+
+  // concatenated streams
+  EXPECT_EQ( gunzip( gzip( "first " ) + gzip( "second" ) ), "first second" );
+
+  EXPECT_THROW( gunzip( compressed.substr( 0, compressed.size() / 2 ) ), std::runtime_error );
+  auto corrupted = compressed;
+  corrupted[20] ^= 0x55;
+  EXPECT_THROW( gunzip( corrupted ), std::runtime_error );
+}
+
 TEST( IOV, Validity ) {
   const IOV reference{10, 20};
 
@@ -18,7 +18,7 @@
 
 #include "gtest/gtest.h"
 
-using namespace GitCondDB::v1;
+using namespace GitCondDB::v2;
 
 TEST( JSONImpl, Connection ) {
   {
@@ -130,6 +130,46 @@ TEST( JSONImpl, AccessMemory ) {
   EXPECT_EQ( db.commit_time( "HEAD" ), std::chrono::time_point<std::chrono::system_clock>::max() );
 }
 
+TEST( JSONImpl, Lookup ) {
+  const std::string data = R"({
+      "Cond": {"IOVs": "0 v0\n", "v0": "data 0", "nested": {"deeper": {"leaf": "leaf data"}}},
+      "a/b": "slash",
+      "a": {"b": "a then b", "": "empty name"},
+      "t~x": "tilde",
+      "list": ["item 0", {"x": "item 1"}],
+      "nothing": null
+    })";
+  const nlohmann::json reference = nlohmann::json::parse( data );
+
+  details::JSONImpl indexed{data};
+  details::JSONImpl plain{data, nullptr, false};
+
+  for ( const char* path : {"", "Cond", "Cond/IOVs", "Cond/nested/deeper/leaf", "Cond/nested/deeper/none", "Cond/v0/x",
+                            "a/b", "a/", "a~1b", "t~0x", "list/0", "list/1/x", "list/2", "nothing", "missing",
+                            "/Cond", "Cond/"} ) {
+    const auto object_id = std::string{"HEAD:"} + path;
+    const auto pointer   = nlohmann::json::json_pointer{*path ? std::string{'/'} + path : std::string{}};
+    const auto expected  = reference.value( pointer, nlohmann::json{} );
+
+    EXPECT_EQ( indexed.exists( object_id.c_str() ), !expected.is_null() ) << "path='" << path << "'";
+    EXPECT_EQ( plain.exists( object_id.c_str() ), !expected.is_null() ) << "path='" << path << "'";
+    if ( expected.is_string() ) {
+      const auto value = expected.get<std::string>();
+      EXPECT_EQ( std::get<0>( indexed.get( object_id.c_str() ) ), value ) << "path='" << path << "'";
+      EXPECT_EQ( std::get<0>( plain.get( object_id.c_str() ) ), value ) << "path='" << path << "'";
+    }
+  }
+
+  // invalid escape sequences
+  EXPECT_FALSE( indexed.exists( "HEAD:t~x" ) );
+  EXPECT_FALSE( plain.exists( "HEAD:t~x" ) );
+
+  // payloads refer to the loaded document
+  const auto first  = std::get<0>( indexed.get_payload( "HEAD:Cond/v0" ) );
+  const auto second = std::get<0>( indexed.get_payload( "HEAD:Cond/v0" ) );
+  EXPECT_EQ( first.data(), second.data() );
+}
+
 int main( int argc, char** argv ) {
   ::testing::InitGoogleTest( &argc, argv );
   return RUN_ALL_TESTS();
@@ -13,8 +13,11 @@
 
 #include <GitCondDB.h>
 
+#include <cstdlib>
+#include <filesystem>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -40,4 +43,12 @@ struct CapturingLogger : GitCondDB::Logger {
   mutable std::vector<std::tuple<std::string, std::string>> logged_messages;
 };
 
+/// Create an empty directory with a unique name in the temporary directory, so that tests run in
+/// parallel (e.g. with ctest -j) do not share it.
+inline std::filesystem::path make_temp_dir( std::string_view prefix ) {
+  auto path = ( std::filesystem::temp_directory_path() / prefix ).string() + ".XXXXXX";
+  if ( !mkdtemp( path.data() ) ) throw std::runtime_error( "cannot create temporary directory " + path );
+  return path;
+}
+
 #endif // TEST_COMMON_H
@@ -3,7 +3,11 @@
 Script to add a set of files to Git CondDB (for an optional IOV).
 '''
 import os
+import io
+import gzip
 import shutil
+import struct
+import zlib
 import logging
 from GitCondDB.IOVs import (IOV_MIN, IOV_MAX,
                             parse_iovs, flatten_iovs, remove_dummy_entries,
@@ -11,13 +15,105 @@ from GitCondDB.IOVs import (IOV_MIN, IOV_MAX,
 from GitCondDB.Payload import fix_system_refs, fix_lines_ends, payload_filename
 
 
-def _write_file(path, data):
-    'helper to write files'
+# minimum size of the payloads to compress (see --compress)
+COMPRESS_MIN_SIZE = None
+
+GZIP_MAGIC = b'\x1f\x8b\x08'
+
+
+# whether to write the binary version of the IOVs files (see --binary-iovs)
+BINARY_IOVS = False
+
+BINARY_IOVS_MAGIC = b'GCDBIOV\x02'
+
+
+def _binary_iovs(raw):
+    '''
+    convert the content (bytes) of a text IOVs file to the binary format read
+    by the library (see binary_IOVs in iov_helpers.h)
+    '''
+    entries = []
+    for line in raw.decode('utf-8').splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].isdigit():
+            entries.append((int(fields[0]), fields[1]))
+    keys, key_ids = [], {}
+    for _, key in entries:
+        if key not in key_ids:
+            key_ids[key] = len(keys)
+            keys.append(key.encode('utf-8'))
+    ids = [key_ids[key] for _, key in entries]
+    repeated_keys = any(a == b for a, b in zip(ids, ids[1:]))
+    key_ends, end = [], 0
+    for key in keys:
+        end += len(key)
+        key_ends.append(end)
+    return b''.join([
+        BINARY_IOVS_MAGIC,
+        struct.pack('<4I', len(entries), len(keys), int(repeated_keys), 0),
+        # identity of the text file, to detect when it changes
+        struct.pack('<QII', len(raw), zlib.crc32(raw) & 0xffffffff, 0),
+        struct.pack('<%dQ' % len(entries), *[since for since, _ in entries]),
+        struct.pack('<%dI' % len(ids), *ids),
+        struct.pack('<%dI' % len(key_ends), *key_ends),
+    ] + keys)
+
+
+def _update_binary_iovs(dest):
+    '''
+    write the binary version of the IOVs files in dest (and below it) if
+    requested with --binary-iovs, or remove it, so that it is never outdated
+    '''
+    if not os.path.isdir(dest):
+        return
+    for root, _, filenames in os.walk(dest):
+        if 'IOVs' not in filenames:
+            continue
+        binary_path = os.path.join(root, 'IOVs.bin')
+        if BINARY_IOVS:
+            logging.debug('writing %s', binary_path)
+            with open(os.path.join(root, 'IOVs'), 'rb') as f:
+                raw = f.read()
+            if raw.startswith(GZIP_MAGIC):
+                raw = gzip.GzipFile(fileobj=io.BytesIO(raw)).read()
+            with open(binary_path, 'wb') as f:
+                f.write(_binary_iovs(raw))
+        elif os.path.exists(binary_path):
+            logging.debug('remove file %s', binary_path)
+            os.remove(binary_path)
+
+
+def _compress(data):
+    'gzip data without timestamp, so that the same data gives the same blob'
+    buf = io.BytesIO()
+    with gzip.GzipFile(filename='', mode='wb', fileobj=buf, mtime=0) as f:
+        f.write(data)
+    return buf.getvalue()
+
+
+def _read_file(path):
+    'helper to read files, decompressing them if needed'
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data.startswith(GZIP_MAGIC):
+        data = gzip.GzipFile(fileobj=io.BytesIO(data)).read()
+    return data if isinstance(data, str) else data.decode('utf-8')
+
+
+def _write_file(path, data, compress=True):
+    'helper to write files (compressed if requested with --compress)'
     dirname = os.path.dirname(path)
     if not os.path.exists(dirname):
         logging.debug('creating directory %s', dirname)
         os.makedirs(dirname)
-    logging.debug('writing %s', path)
+    if not isinstance(data, bytes):
+        data = data.encode('utf-8')
+    if (compress and COMPRESS_MIN_SIZE is not None
+            and len(data) >= COMPRESS_MIN_SIZE):
+        logging.debug('writing %s (compressed)', path)
+        data = _compress(data)
+    else:
+        logging.debug('writing %s', path)
     with open(path, 'wb') as f:
         f.write(data)
 
@@ -41,8 +137,7 @@ def _add_file_with_iov(data, dest, iov):
         _add_file_no_iov(data, dest)
     elif not os.path.isdir(dest):
         # the existing entry covers whole timespan
-        with open(dest) as f:
-            old_data = f.read()
+        old_data = _read_file(dest)
         if old_data == data:
             logging.warning('same data: not changing %s', dest)
         else:
@@ -60,10 +155,11 @@ def _add_file_with_iov(data, dest, iov):
             data.append((iov[0], new_payload_name))
             if iov[1] < IOV_MAX:
                 data.append((iov[1], old_payload_name))
+            # IOVs files are left uncompressed for the other tools
             _write_file(os.path.join(dest, 'IOVs'), '\n'.join(
                 '{0} {1}'.format(since, payload)
                 for since, payload in data
-            ) + '\n')
+            ) + '\n', compress=False)
     else:
         orig_iovs = parse_iovs(dest)
         key = payload_filename(data)
@@ -80,7 +176,7 @@ def _add_file_with_iov(data, dest, iov):
             data_file_name = os.path.join(dest, key)
             if os.path.exists(data_file_name):
                 # just to check
-                if open(data_file_name).read() != data:
+                if _read_file(data_file_name) != data:
                     logging.error('hash clash on %s', data_file_name)
             else:
                 _write_file(data_file_name, data)
@@ -102,6 +198,7 @@ def git_conddb_add_file(source, dest, root, since=IOV_MIN, until=IOV_MAX):
         _add_file_no_iov(data, dest)
     else:
         _add_file_with_iov(data, dest, iov)
+    _update_binary_iovs(dest)
 
 
 def git_conddb_extend(source, dest, since=IOV_MIN, until=IOV_MAX):
@@ -121,6 +218,15 @@ def main():
     parser.add_option('--until',
                       help='end of validity for the files')
 
+    parser.add_option('--compress', metavar='MIN_SIZE', type='int',
+                      help='write payloads of at least MIN_SIZE bytes '
+                      'compressed with gzip (to be read with '
+                      'ConnectOptions::decompress_payloads)')
+
+    parser.add_option('--binary-iovs', action='store_true',
+                      help='write also the binary version of the IOVs files '
+                      '(IOVs.bin), faster to read')
+
     parser.add_option('--quiet',
                       action='store_const', const=logging.WARNING,
                       dest='log_level',
@@ -141,6 +247,10 @@ def main():
     opts, args = parser.parse_args()
     logging.basicConfig(level=opts.log_level)
 
+    global COMPRESS_MIN_SIZE, BINARY_IOVS
+    COMPRESS_MIN_SIZE = opts.compress
+    BINARY_IOVS = opts.binary_iovs
+
     if len(args) == 2:
         source, dest = args
     else:
@@ -3,31 +3,31 @@
 *  read_gitconddb
 *  ==============
 *   - Print a condition for a given repository, source, tag and time
-*   - Clone a list of conditions for a given repository, source and tag
-* 
+*   - Export a source directory for a given repository, source and tag
+*     to ~/.cache/snemo/<tag>/<source> (or the directory given with -o)
+*
 *  P. Franchini 2019 for SuperNEMO
 *
 \******************************************************************************/
 
 #include "GitCondDB.h"
-#include "DBImpl.h"
-#include <iostream>
+#include "export_helpers.h"
 #include <stdio.h>
-#include <string.h>
-#include "DBImpl.h"
 #include <getopt.h>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
-#include <fstream>
-#include <nlohmann/json.hpp>
-#include <sys/stat.h> 
-#include <sys/types.h> 
+#include <string>
+#include <thread>
 
-using json = nlohmann::json;
+namespace fs = std::filesystem;
 
 void print_usage() {
-  printf("Usage: read_gitconddb -v <tag> -r <[file|git]:local_repository_path> -s <source> (-c <condition>) (-t <time>) \n\n");
+  printf("Usage: read_gitconddb (-v <tag>) -r <[file|git]:local_repository_path> -s <source> (-c <condition>) (-t <time>) (-j <threads>) (-o <output_directory>)\n\n");
+  // the tag is HEAD if not given
   // omitting file|git: corresponds to git:
   // should probably avoid using file: because uses the local checkout, whatever tag it is, so the -v tag is not really considered
+  // without -c the source directory is exported to <output_directory>/<tag>/<source> (default ~/.cache/snemo)
 }
 
 int main(int argc, char **argv) {
@@ -40,10 +40,12 @@ int main(int argc, char **argv) {
   char *repository = NULL;
   char *source = NULL;
   char *condition = NULL;
-  long unsigned int time = 0;
-  
+  char *output = NULL;
+  GitCondDB::CondDB::time_point_t time = 0;
+  std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
   int option_index = 0;
-  while (( option_index = getopt(argc, argv, "v:r:s:c:t:")) != -1){
+  while (( option_index = getopt(argc, argv, "v:r:s:c:t:j:o:")) != -1){
     switch (option_index) {
     case 'v':
       tag = optarg;
@@ -58,14 +60,26 @@ int main(int argc, char **argv) {
       condition = optarg;
       break;
     case 't':
-      time = atof(optarg);
+      time = std::strtoull(optarg, nullptr, 10);
+      break;
+    case 'j':
+      threads = std::max(1ul, std::strtoul(optarg, nullptr, 10));
+      break;
+    case 'o':
+      output = optarg;
       break;
     default:
       printf("Option incorrect\n");
       print_usage();
       return 1;
-    } 
-  }  
+    }
+  }
+
+  // the tag is also used as a directory name for the export
+  if (!tag || !*tag || !repository || !source) {
+    print_usage();
+    return 1;
+  }
 
   std::cout << std::endl << "Repository: " << repository << std::endl;
   std::cout << "Tag: " << tag << std::endl;
@@ -73,67 +87,26 @@ int main(int argc, char **argv) {
   if (condition) std::cout << "Condition: " << condition << std::endl;
   std::cout << "Time: " << time << std::endl << std::endl;
 
-  char path[80];
-  strcpy(path, source);
+  GitCondDB::ConnectOptions options;
+  options.repository_handles = threads;
+  auto db = GitCondDB::connect( repository, options );
+
+  // Print condition and IOV for the given repository, source, condition, tag and (time)
   if (condition) {
-    strcat(path, "/");
-    strcat(path, condition);
+    GitCondDB::CondDB::Key key{tag, std::string(source) + "/" + condition, time};
+    auto cond = db.get(key);
+    std::cout << "Data:\n" << std::get<0>( cond ) << std::endl << std::endl;
+    if (time) std::cout << "IOV: [" <<  std::get<1>( cond ).since << ", " << std::get<1>( cond ).until << ")\n\n";
+    return 0;
   }
-  
-  // Print condition and IOV for the given repository, source, (condition), tag and (time)
-  auto db = GitCondDB::connect( repository );
-  GitCondDB::CondDB::Key key{tag,path,time};
-  auto cond = db.get(key);
-  std::cout << "Data:\n" << std::get<0>( cond ) << std::endl << std::endl;
-  if (time) std::cout << "IOV: [" <<  std::get<1>( cond ).since << ", " << std::get<1>( cond ).until << ")\n\n";
-  
-  // Clone the full directory for a given repository, source and tag
-  if (!condition){
-
-    // Create/read a json file and write each file on the cache
-    std::ofstream json_file;
-    json_file.open ("repo.json");
-    json_file << std::get<0>( cond );
-    json_file.close();
-    json j;
-    std::ifstream i("repo.json");
-    i >> j;
-
-    for (auto itr : j["files"]) {
-
-      struct stat st;
-      
-      // Read each single file 
-      std::string file =  itr;  
-      strcpy(path, source); 
-      strcat(path, "/"); 
-      strcat(path, file.c_str());
-      auto [file_content, iov] = db.get( {tag, path, time} );  
-
-      // Create directory for tag/
-      char full_path[80];
-      strcpy(full_path,HOME);
-      strcat(full_path,"/");
-      strcat(full_path,CACHE_DIR.c_str());
-      strcat(full_path,"/");
-      strcat(full_path,tag);
-      if (stat(full_path, &st) == -1) mkdir(full_path,0755); 
-      
-      // Create directory for source/
-      strcat(full_path,"/");
-      strcat(full_path,source);
-      if (stat(full_path, &st) == -1) mkdir(full_path,0755); 
 
-      // Write file in the cache directory
-      strcat(full_path,"/");
-      strcat(full_path,file.c_str());
-      std::cout << full_path << std::endl;
-      std::ofstream f(full_path);
-      f << file_content;
-      
-    }//for
-  }//if
-  
-  return 0;
+  // Export the full directory for a given repository, source and tag
+  fs::path dest = output ? fs::path(output) : fs::path(HOME ? HOME : ".") / CACHE_DIR;
+  dest = dest / tag / source;
+  const auto result = GitCondDB::Helpers::export_directory(db, tag, source, time, dest, threads);
+  for (const auto& error : result.errors) std::cerr << "Error: " << error << std::endl;
+  std::cout << "Exported " << result.files << " files to " << dest.string() << " (" << result.written << " written, "
+            << result.unchanged << " unchanged, " << result.removed << " removed)" << std::endl;
+  return result.errors.empty() ? 0 : 1;
 
 }
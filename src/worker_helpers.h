@@ -0,0 +1,155 @@
+#ifndef WORKER_HELPERS_H
+#define WORKER_HELPERS_H
+/*****************************************************************************\
+* (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           *
+*                                                                             *
+* This software is distributed under the terms of the Apache version 2        *
+* licence, copied verbatim in the file "COPYING".                             *
+*                                                                             *
+* In applying this licence, CERN does not waive the privileges and immunities *
+* granted to it by virtue of its status as an Intergovernmental Organization  *
+* or submit itself to any jurisdiction.                                       *
+\*****************************************************************************/
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace GitCondDB {
+  namespace Helpers {
+    /// Thread executing tasks in the background, one at a time.
+    ///
+    /// Tasks are identified by a key, and a task is ignored if one with the same key is already queued
+    /// or was executed recently. Tasks must not throw.
+    class background_worker {
+    public:
+      background_worker( std::size_t max_queue = 64, std::size_t max_recent = 1024 )
+          : m_max_queue{max_queue}, m_max_recent{max_recent} {}
+
+      /// Stop the thread, dropping the tasks not yet started.
+      ~background_worker() {
+        {
+          std::lock_guard<std::mutex> guard( m_mutex );
+          m_stop = true;
+          m_queue.clear();
+        }
+        m_work.notify_all();
+        if ( m_thread.joinable() ) m_thread.join();
+      }
+
+      /// Queue a task, returning false if it was ignored (duplicated key or full queue).
+      bool submit( std::string key, std::function<void()> task ) {
+        {
+          std::lock_guard<std::mutex> guard( m_mutex );
+          if ( m_queue.size() >= m_max_queue || m_recent.count( key ) ) return false;
+          if ( m_recent.size() >= m_max_recent ) m_recent.clear();
+          m_recent.insert( key );
+          m_queue.emplace_back( std::move( key ), std::move( task ) );
+          if ( !m_thread.joinable() ) m_thread = std::thread{[this]() { run(); }};
+        }
+        m_work.notify_one();
+        return true;
+      }
+
+      /// Wait until all queued tasks are completed.
+      void wait() {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_idle.wait( lock, [this]() { return m_queue.empty() && !m_busy; } );
+      }
+
+    private:
+      void run() {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true ) {
+          m_work.wait( lock, [this]() { return m_stop || !m_queue.empty(); } );
+          if ( m_stop ) break;
+          auto task = std::move( m_queue.front().second );
+          m_queue.pop_front();
+          m_busy = true;
+          lock.unlock();
+          task();
+          lock.lock();
+          m_busy = false;
+          if ( m_queue.empty() ) m_idle.notify_all();
+        }
+        m_busy = false;
+        m_idle.notify_all();
+      }
+
+      const std::size_t m_max_queue;
+      const std::size_t m_max_recent;
+
+      std::mutex                                                m_mutex;
+      std::condition_variable                                   m_work;
+      std::condition_variable                                   m_idle;
+      std::deque<std::pair<std::string, std::function<void()>>> m_queue;
+      /// Keys of the tasks queued or executed recently.
+      std::unordered_set<std::string> m_recent;
+      bool                            m_busy = false;
+      bool                            m_stop = false;
+
+      std::thread m_thread;
+    };
+
+    /// Pool of threads executing tasks in order of submission (the threads are started on the first one).
+    class thread_pool {
+    public:
+      thread_pool( std::size_t n_threads ) : m_n_threads{std::max<std::size_t>( n_threads, 1 )} {}
+
+      /// Complete the queued tasks and stop the threads.
+      ~thread_pool() {
+        {
+          std::lock_guard<std::mutex> guard( m_mutex );
+          m_stop = true;
+        }
+        m_work.notify_all();
+        for ( auto& thread : m_threads ) thread.join();
+      }
+
+      void submit( std::function<void()> task ) {
+        {
+          std::lock_guard<std::mutex> guard( m_mutex );
+          m_queue.emplace_back( std::move( task ) );
+          if ( m_threads.empty() ) {
+            for ( std::size_t i = 0; i < m_n_threads; ++i ) m_threads.emplace_back( [this]() { run(); } );
+          }
+        }
+        m_work.notify_one();
+      }
+
+      std::size_t size() const { return m_n_threads; }
+
+    private:
+      void run() {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true ) {
+          m_work.wait( lock, [this]() { return m_stop || !m_queue.empty(); } );
+          if ( m_queue.empty() ) break; // stopping and nothing left to do
+          auto task = std::move( m_queue.front() );
+          m_queue.pop_front();
+          lock.unlock();
+          task();
+          lock.lock();
+        }
+      }
+
+      const std::size_t m_n_threads;
+
+      std::mutex                        m_mutex;
+      std::condition_variable           m_work;
+      std::deque<std::function<void()>> m_queue;
+      bool                              m_stop = false;
+
+      std::vector<std::thread> m_threads;
+    };
+  } // namespace Helpers
+} // namespace GitCondDB
+
+#endif // WORKER_HELPERS_H
@@ -0,0 +1,249 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+###############################################################################
+# (c) Copyright 2018 CERN for the benefit of the LHCb Collaboration           #
+#                                                                             #
+# This software is distributed under the terms of the Apache version 2        #
+# licence, copied verbatim in the file "COPYING".                             #
+#                                                                             #
+# In applying this licence, CERN does not waive the privileges and immunities #
+# granted to it by virtue of its status as an Intergovernmental Organization  #
+# or submit itself to any jurisdiction.                                       #
+###############################################################################
+from __future__ import print_function
+'''
+Script to prepare the repositories used by the benchmarks.
+
+Besides the fixed data used by the benchmarks, it can generate synthetic
+repositories of any size (see the --output option).
+'''
+
+import sys
+import os
+import logging
+from os.path import join, exists
+from shutil import rmtree
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from prepare_test_data import call, makedirs
+
+#: depths at which the benchmarks look for conditions
+DEPTHS = (1, 4, 8, 16)
+#: number of dummy entries in each directory along the paths
+SIBLINGS = 20
+
+
+def deep_path(depth):
+    '''
+    Path (with "/" separators) of the condition at the given depth.
+    '''
+    return '/'.join(['level{0}'.format(i) for i in range(1, depth)] + ['Cond'])
+
+
+def create_deep_repo(path):
+    '''
+    Create a repository with conditions under increasingly deep paths.
+    '''
+    if exists(path):
+        rmtree(path)
+
+    call(['git', 'init', path])
+    call(['git', 'config', '-f', '.git/config', 'user.name', 'Test User'],
+         cwd=path)
+    call([
+        'git', 'config', '-f', '.git/config', 'user.email',
+        'test.user@no.where'
+    ],
+         cwd=path)
+
+    for depth in DEPTHS:
+        cond = join(path, *deep_path(depth).split('/'))
+        makedirs(cond)
+        with open(join(cond, 'IOVs'), 'w') as f:
+            f.write('0 v0\n100 v1\n')
+        for key in ('v0', 'v1'):
+            with open(join(cond, key), 'w') as f:
+                f.write('data {0} at depth {1}\n'.format(key, depth))
+
+    # make the trees along the paths a bit more realistic
+    for root, dirs, _ in os.walk(path):
+        if '.git' in dirs:
+            dirs.remove('.git')
+        for i in range(SIBLINGS):
+            with open(join(root, 'sibling{0:02}'.format(i)), 'w') as f:
+                f.write('dummy {0}\n'.format(i))
+
+    env = dict(os.environ)
+    env['GIT_COMMITTER_DATE'] = env['GIT_AUTHOR_DATE'] = '1483225200'
+    call(['git', 'add', '.'], cwd=path)
+    call(['git', 'commit', '-m', 'deep data'], cwd=path, env=env)
+    call(['git', 'tag', 'v0'], cwd=path, env=env)
+
+    if exists(path + '.git'):
+        rmtree(path + '.git')
+    call(['git', 'clone', '--mirror', path, path + '.git'])
+
+
+#: parameters of the synthetic repository used by the benchmarks
+#: (see src/benchmarks/CondDB_Benchmarks.cpp)
+SYNTHETIC = dict(conditions=200, iovs=20, nesting=1, payload_size=128, tags=3)
+#: number of conditions per directory in the synthetic repository
+CONDITIONS_PER_DIR = 10
+#: length of the IOVs in the synthetic repository
+IOV_LENGTH = 100
+#: maximum number of entries pointing to nested IOVs tables in an IOVs file
+FANOUT = 4
+
+
+def synthetic_path(index):
+    '''
+    Path (with "/" separators) of a condition in the synthetic repository.
+    '''
+    return 'Conditions/dir{0:03}/Cond{1}'.format(index // CONDITIONS_PER_DIR,
+                                                index % CONDITIONS_PER_DIR)
+
+
+def write_iovs_tree(path, since, count, nesting, payload):
+    '''
+    Write in path an IOVs table for `count` IOVs starting at `since`, split
+    over `nesting` levels of nested IOVs tables.
+
+    `payload` is a function returning the data for a given time point.
+    '''
+    makedirs(path)
+    entries = []
+    if nesting <= 0 or count <= 1:
+        for i in range(count):
+            t = since + i * IOV_LENGTH
+            key = 'v{0}'.format(t)
+            with open(join(path, key), 'w') as f:
+                f.write(payload(t))
+            entries.append((t, key))
+    else:
+        groups = min(count, FANOUT)
+        for g in range(groups):
+            first = g * count // groups
+            size = (g + 1) * count // groups - first
+            t = since + first * IOV_LENGTH
+            key = 'g{0}'.format(t)
+            write_iovs_tree(
+                join(path, key), t, size, nesting - 1, payload)
+            entries.append((t, key))
+    with open(join(path, 'IOVs'), 'w') as f:
+        f.write(''.join('{0} {1}\n'.format(t, key) for t, key in entries))
+
+
+def to_json(path):
+    '''
+    Return the content of a directory as a JSON compatible dictionary.
+    '''
+    data = {}
+    for name in os.listdir(path):
+        if name == '.git':
+            continue
+        entry = join(path, name)
+        if os.path.isdir(entry):
+            data[name] = to_json(entry)
+        else:
+            with open(entry) as f:
+                data[name] = f.read()
+    return data
+
+
+def create_synthetic_repo(path, conditions, iovs, nesting, payload_size,
+                          tags):
+    '''
+    Create a repository with `conditions` conditions of `iovs` IOVs each
+    (spread over `nesting` levels of nested IOVs tables), with payloads of
+    `payload_size` bytes.
+
+    Each of the `tags` tags (v0, v1, ...) changes the payloads of a fraction
+    of the conditions. Next to the Git repository (and its bare clone
+    `<path>.git`), the content of the last tag is also written to
+    `<path>.json`, for the JSON backend.
+    '''
+    import json
+
+    if exists(path):
+        rmtree(path)
+
+    call(['git', 'init', path])
+    call(['git', 'config', '-f', '.git/config', 'user.name', 'Test User'],
+         cwd=path)
+    call([
+        'git', 'config', '-f', '.git/config', 'user.email',
+        'test.user@no.where'
+    ],
+         cwd=path)
+
+    env = dict(os.environ)
+    for tag in range(tags):
+        for index in range(conditions):
+            # the first tag contains all conditions, the others change
+            # one condition out of `tags`
+            if tag and index % tags != tag:
+                continue
+            cond = synthetic_path(index)
+            cond_dir = join(path, *cond.split('/'))
+            if exists(cond_dir):
+                rmtree(cond_dir)
+
+            def payload(t, cond=cond, tag=tag):
+                line = '{0} at {1} in v{2}\n'.format(cond, t, tag)
+                return (line * (payload_size // len(line) + 1))[:payload_size]
+
+            write_iovs_tree(cond_dir, 0, iovs, nesting, payload)
+
+        env['GIT_COMMITTER_DATE'] = env['GIT_AUTHOR_DATE'] = str(
+            1483225200 + tag * 3600)
+        call(['git', 'add', '-A', '.'], cwd=path)
+        call(['git', 'commit', '-m', 'synthetic data v{0}'.format(tag)],
+             cwd=path,
+             env=env)
+        call(['git', 'tag', 'v{0}'.format(tag)], cwd=path, env=env)
+
+    if exists(path + '.git'):
+        rmtree(path + '.git')
+    call(['git', 'clone', '--mirror', path, path + '.git'])
+    # like production repositories, keep the objects in a packfile
+    call(['git', 'repack', '-a', '-d', '-q'], cwd=path + '.git')
+
+    with open(path + '.json', 'w') as f:
+        json.dump(to_json(path), f)
+
+
+def main():
+    from argparse import ArgumentParser
+    parser = ArgumentParser(description=__doc__)
+    parser.add_argument(
+        '--output',
+        help='generate only a synthetic repository in the given directory '
+        '(default: generate all the benchmark data in bench_data)')
+    for name, value in sorted(SYNTHETIC.items()):
+        parser.add_argument(
+            '--' + name.replace('_', '-'),
+            type=int,
+            default=value,
+            help='parameter of the synthetic repository (default: %(default)s)')
+    parser.add_argument('--debug', action='store_true')
+    args = parser.parse_args()
+
+    level = (logging.DEBUG if
+             (args.debug or os.environ.get('VERBOSE')) else logging.WARNING)
+    logging.basicConfig(level=level)
+
+    params = dict((name, getattr(args, name)) for name in SYNTHETIC)
+    if args.output:
+        create_synthetic_repo(join(args.output, 'repo'), **params)
+        return
+
+    if exists('bench_data'):
+        logging.debug('removing existing bench_data')
+        rmtree('bench_data')
+
+    create_deep_repo(join('bench_data', 'deep', 'repo'))
+    create_synthetic_repo(join('bench_data', 'synthetic', 'repo'), **params)
+
+
+if __name__ == '__main__':
+    main()
@@ -168,7 +168,7 @@ def create_mini_repo(path):
 
     call(['git', 'add', '.'], cwd=path)
     env['GIT_COMMITTER_DATE'] = env['GIT_AUTHOR_DATE'] = '1483225100'
-    call(['git', 'commit', '-m', 'message 1'], cwd=path, env=env)
+    call(['git', 'commit', '-m', 'first: message 1'], cwd=path, env=env)
     call(['git', 'tag', 'v0'], cwd=path, env=env)
 
     with open(join(path, 'Cond', 'IOVs'), 'w') as f: